@@ -0,0 +1,33 @@
+#include "Backoff.h"
+#include <algorithm>
+
+Backoff::Backoff(int64_t baseMs, int64_t maxMs)
+    : attempt(0)
+    , random(std::random_device()()) {
+    this->configure(baseMs, maxMs);
+}
+
+void Backoff::configure(int64_t baseMs, int64_t maxMs) {
+    this->baseMs = std::max<int64_t>(baseMs, 1);
+    this->maxMs = std::max(maxMs, this->baseMs);
+}
+
+int64_t Backoff::next() {
+    // Stop doubling once past the cap so the shift can't overflow.
+    int64_t ceiling = this->maxMs;
+    if (this->attempt < 62 && this->baseMs <= (this->maxMs >> this->attempt)) {
+        ceiling = this->baseMs << this->attempt;
+        this->attempt++;
+    }
+
+    std::uniform_int_distribution<int64_t> jitter(0, ceiling);
+    return jitter(this->random);
+}
+
+void Backoff::reset() {
+    this->attempt = 0;
+}
+
+int Backoff::getAttempt() {
+    return this->attempt;
+}
@@ -0,0 +1,63 @@
+/**
+ *   \file Backoff.h
+ *   \brief Exponential backoff with full jitter.
+ *
+ *  Each delay is drawn uniformly from [0, min(max, base * 2^attempt)], so
+ *  clients that lost the same server together spread their retries out
+ *  instead of coming back in lockstep.
+ */
+#ifndef Backoff_H
+#define Backoff_H
+
+#include <cstdint>
+#include <random>
+
+class Backoff {
+public:
+    /**
+     *  \brief Constructor
+     *
+     *  \param baseMs The ceiling of the first delay, in milliseconds.
+     *  \param maxMs The largest the ceiling grows to, in milliseconds.
+     *  \return Backoff
+     */
+    Backoff(int64_t baseMs, int64_t maxMs);
+
+    /**
+     *  \brief Changes the delays. Doesn't reset the attempt count.
+     *
+     *  \param baseMs The ceiling of the first delay, in milliseconds.
+     *  \param maxMs The largest the ceiling grows to, in milliseconds.
+     *  \return void
+     */
+    void configure(int64_t baseMs, int64_t maxMs);
+
+    /**
+     *  \brief Draws the delay before the next attempt and counts it.
+     *
+     *  \return int64_t Milliseconds.
+     */
+    int64_t next();
+
+    /**
+     *  \brief Starts over from the base delay.
+     *
+     *  \return void
+     */
+    void reset();
+
+    /**
+     *  \brief Attempts since the last reset.
+     *
+     *  \return int
+     */
+    int getAttempt();
+
+private:
+    int64_t baseMs;
+    int64_t maxMs;
+    int attempt;
+    std::mt19937_64 random;
+};
+
+#endif // Backoff_H
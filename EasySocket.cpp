@@ -1,40 +1,94 @@
 #include "EasySocket.h"
 #include "SocketDelegate.h"
 #include "easylogging++.h"
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
 #include <thread>
 
+namespace {
+
+int64_t nowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+} // namespace
+
 // Make sure to implement this constructor if you take out the
 // Base class constructor call.
 // Otherwise, it'll throw `symbol not found` exceptions when compiling.
 EasySocket::EasySocket(const std::string& url, SocketDelegate* delegate)
     : WebSocket(url, delegate)
-    , receiveQueue(1) {
+    , reactor(Reactor::running())
+    , receiveQueue(reactor)
+    , watchId(0)
+    , closeRequested(false)
+    , wakePending(false)
+    , batchStart(0)
+    , batchWindow(0)
+    , flushRequested(false)
+    , framesSent(0)
+    , writesMade(0)
+    , pingDue(false)
+    , pingSentAt(0)
+    , pingTimer(0) {
     this->state = SocketClosed;
 }
 
+EasySocket::~EasySocket() {
+    TimerWheel::shared().cancel(this->pingTimer);
+}
+
+void EasySocket::resetConnection(
+    std::shared_ptr<easywsclient::WebSocket> socket) {
+    // Drop whatever was left from a previous connection.
+    std::string stale;
+    while (this->outgoing.pop(stale)) {
+    }
+    this->closeRequested = false;
+    this->wakePending = false;
+    this->framesSent = 0;
+    this->writesMade = 0;
+    this->pingDue = false;
+    this->pingSentAt = 0;
+
+    // Whatever services the old connection frees it when done. A worker
+    // may be asleep in poll(), so wake it to notice it was replaced.
+    std::shared_ptr<easywsclient::WebSocket> old
+        = std::atomic_exchange(&this->socket, std::move(socket));
+    if (old && !this->reactor) {
+        old->wakeup();
+    }
+}
+
 void EasySocket::open() {
-    easywsclient::WebSocket::pointer socket
-        = easywsclient::WebSocket::from_url(this->url);
+    if (this->reactor) {
+        this->openOnReactor();
+        return;
+    }
+
+    std::shared_ptr<EasySocket> self = this->shared_from_this();
+    std::shared_ptr<easywsclient::WebSocket> socket(
+        easywsclient::WebSocket::from_url(this->url));
+    this->resetConnection(socket);
 
     if (!socket) {
         this->state = SocketClosed;
-        std::thread errorThread([this]() {
-            SocketDelegate* d = this->delegate;
+        std::thread errorThread([self]() {
+            SocketDelegate* d = self->delegate;
             if (d) {
-                d->webSocketDidError(this, "");
+                d->webSocketDidError(self.get(), "");
             }
         });
         errorThread.detach();
-
-        this->socket = nullptr;
         return;
     }
 
-    this->socket = socket;
-
-    std::thread worker([this]() {
-        easywsclient::WebSocket::pointer ws = this->socket;
+    // The worker holds on to the socket, which is freed once it exits.
+    std::thread worker([this, self, socket]() {
+        easywsclient::WebSocket::pointer ws = socket.get();
         // This worker thread will continue to loop as long as the Websocket
         // is connected. Once we get a CLOSED message, this will be set to
         // false and the loop (and thread) will be exited.
@@ -45,18 +99,20 @@ void EasySocket::open() {
         // the callback and then set this to true so we only do it once.
         bool triggeredWebsocketJoinedCallback = false;
 
-        using std::placeholders::_1;
-        std::function<void(std::string)> callable
-            = std::bind(&EasySocket::handleMessage, this, _1);
-
         while (shouldContinueLoop) {
+            // open() took on another connection, which this one mustn't
+            // report for.
+            if (std::atomic_load(&self->socket) != socket) {
+                return;
+            }
+
             switch (ws->getReadyState()) {
             case easywsclient::WebSocket::CLOSED: {
                 this->state = SocketClosed;
-                std::thread closeThread([this]() {
-                    SocketDelegate* d = this->delegate;
+                std::thread closeThread([self]() {
+                    SocketDelegate* d = self->delegate;
                     if (d) {
-                        d->webSocketDidClose(this, 0, "", true);
+                        d->webSocketDidClose(self.get(), 0, "", true);
                     }
                 });
                 closeThread.detach();
@@ -66,21 +122,17 @@ void EasySocket::open() {
                 break;
             }
             case easywsclient::WebSocket::CLOSING: {
-                this->state = SocketClosing;
-                std::lock_guard<std::mutex> guard(this->socketMutex);
-                ws->poll();
-                ws->dispatch(callable);
+                this->updateState(SocketClosing);
+                this->pollSocket(ws);
                 break;
             }
             case easywsclient::WebSocket::CONNECTING: {
-                this->state = SocketConnecting;
-                std::lock_guard<std::mutex> guard(this->socketMutex);
-                ws->poll();
-                ws->dispatch(callable);
+                this->updateState(SocketConnecting);
+                this->pollSocket(ws);
                 break;
             }
             case easywsclient::WebSocket::OPEN: {
-                this->state = SocketOpen;
+                this->updateState(SocketOpen);
                 if (!triggeredWebsocketJoinedCallback) {
                     triggeredWebsocketJoinedCallback = true;
                     this->getSocketState();
@@ -90,9 +142,7 @@ void EasySocket::open() {
                     }
                 }
 
-                std::lock_guard<std::mutex> guard(this->socketMutex);
-                ws->poll();
-                ws->dispatch(callable);
+                this->pollSocket(ws);
                 break;
             }
             default: { break; }
@@ -100,42 +150,365 @@ void EasySocket::open() {
         }
 
         this->state = SocketClosed;
-        this->socket = nullptr;
     });
 
     worker.detach();
 }
 
+void EasySocket::openOnReactor() {
+    std::shared_ptr<EasySocket> self = this->shared_from_this();
+    this->reactor->unwatch(this->watchId.exchange(0));
+    this->resetConnection(nullptr);
+    this->state = SocketConnecting;
+
+    // The handshake blocks, so it gets a thread of its own rather than
+    // holding up every connection on a reactor thread.
+    std::thread connector([self]() {
+        std::shared_ptr<easywsclient::WebSocket> ws(
+            easywsclient::WebSocket::from_url(self->url));
+        SocketDelegate* d = self->delegate;
+        if (!ws) {
+            self->state = SocketClosed;
+            if (d) {
+                d->webSocketDidError(self.get(), "");
+            }
+            return;
+        }
+
+        // close() was called while connecting.
+        if (self->closeRequested) {
+            self->state = SocketClosed;
+            if (d) {
+                d->webSocketDidClose(self.get(), 0, "", true);
+            }
+            return;
+        }
+
+        // The watch holds on to the socket, which is freed once the reactor
+        // releases the watch, between passes.
+        std::atomic_store(&self->socket, ws);
+        bool opened = false;
+        Reactor::WatchId id = self->reactor->watch(ws->getSocketFd(),
+            [self, ws, opened]() mutable {
+                self->serviceSocket(ws.get(), opened);
+            },
+            &self->receiveQueue);
+        if (!id) {
+            self->state = SocketClosed;
+            if (d) {
+                d->webSocketDidError(self.get(), "");
+            }
+            return;
+        }
+
+        // The first service announces the connection.
+        self->watchId = id;
+        self->reactor->wake(id);
+    });
+
+    connector.detach();
+}
+
 void EasySocket::close() {
-    this->state = SocketClosed;
-    // Was already closed or never opened.
-    if (!this->socket) {
+    std::shared_ptr<easywsclient::WebSocket> sock
+        = std::atomic_load(&this->socket);
+    // Was already closed or never opened. On the reactor, the handshake may
+    // still be under way; it checks closeRequested once done.
+    if (!sock && !this->reactor) {
+        this->state = SocketClosed;
         return;
     }
 
-    this->socket->close();
+    // The worker owns the socket, so let it do the closing. Together, so
+    // updateState() can't slip an open in between.
+    {
+        std::lock_guard<std::mutex> guard(this->batchMutex);
+        this->closeRequested = true;
+        this->state = SocketClosed;
+    }
+    this->batchWakeup.notify_one();
+    if (sock) {
+        this->wake(sock.get());
+    }
 }
 
 void EasySocket::send(const std::string& message) {
-    std::thread thread([this, message]() {
-        std::lock_guard<std::mutex> guard(this->socketMutex);
-        // Grab a copy of the pointer in case it gets NULLed out.
-        easywsclient::WebSocket::pointer sock = this->socket;
-        if (sock && this->state == SocketOpen) {
-            sock->send(message);
-        }
+    std::shared_ptr<easywsclient::WebSocket> sock
+        = std::atomic_load(&this->socket);
+    if (sock && this->state == SocketOpen) {
+        this->outgoing.push(message);
+        this->wakeForSend(sock.get());
+    }
+}
+
+void EasySocket::send(std::string&& message) {
+    std::shared_ptr<easywsclient::WebSocket> sock
+        = std::atomic_load(&this->socket);
+    if (sock && this->state == SocketOpen) {
+        this->outgoing.push(std::move(message));
+        this->wakeForSend(sock.get());
+    }
+}
+
+void EasySocket::setBatchWindow(int64_t us) {
+    this->batchWindow = us > 0 ? us : 0;
+}
+
+void EasySocket::flush() {
+    {
+        std::lock_guard<std::mutex> guard(this->batchMutex);
+        this->flushRequested = true;
+    }
+    this->batchWakeup.notify_one();
+    if (this->reactor) {
+        this->reactor->wake(this->watchId);
+    }
+}
+
+SendStats EasySocket::getSendStats() {
+    SendStats stats;
+    stats.frames = this->framesSent;
+    stats.writes = this->writesMade;
+    return stats;
+}
+
+void EasySocket::setPingInterval(int ms) {
+    std::lock_guard<std::mutex> guard(this->pingMutex);
+    TimerWheel::shared().cancel(this->pingTimer);
+    this->pingTimer = 0;
+    if (ms <= 0) {
+        return;
+    }
+
+    std::weak_ptr<EasySocket> weak = this->shared_from_this();
+    this->pingTimer = TimerWheel::shared().schedule(ms,
+        [weak]() {
+            std::shared_ptr<EasySocket> self = weak.lock();
+            if (!self) {
+                return;
+            }
+
+            std::shared_ptr<easywsclient::WebSocket> sock
+                = std::atomic_load(&self->socket);
+            if (sock && self->state == SocketOpen) {
+                self->pingDue = true;
+                self->wake(sock.get());
+            }
+        },
+        ms);
+}
+
+LatencyHistogram EasySocket::getPingRtt() {
+    std::lock_guard<std::mutex> guard(this->pingMutex);
+    return this->pingRtt;
+}
+
+void EasySocket::wake(easywsclient::WebSocket::pointer sock, int64_t delayUs) {
+    if (this->reactor) {
+        this->reactor->wake(this->watchId, delayUs);
+    } else {
+        sock->wakeup();
+    }
+}
+
+void EasySocket::wakeForSend(easywsclient::WebSocket::pointer sock) {
+    // Only the send that starts a batch wakes the worker; the rest ride
+    // along. This comes after the push, so the worker, which clears the flag
+    // before draining, can't miss the message.
+    if (!this->wakePending.exchange(true)) {
+        this->batchStart = nowMicros();
+        this->wake(sock, this->batchWindow);
+    }
+}
+
+void EasySocket::holdBatch() {
+    int64_t window = this->batchWindow;
+    if (window <= 0) {
+        return;
+    }
+
+    // Incoming frames wait too, so keep the window short.
+    std::chrono::steady_clock::time_point deadline(
+        std::chrono::microseconds(this->batchStart + window));
+    std::unique_lock<std::mutex> lock(this->batchMutex);
+    this->batchWakeup.wait_until(lock, deadline, [this]() {
+        return this->flushRequested || this->closeRequested;
     });
-    thread.detach();
 }
 
-void EasySocket::handleMessage(const std::string& message) {
-    LOG(INFO) << message + "\n";
-    this->receiveQueue.enqueue([this, message]() {
-        SocketDelegate* d = this->delegate;
-        if (d) {
-            d->webSocketDidReceive(this, message);
+bool EasySocket::isBatchHeld() {
+    int64_t window = this->batchWindow;
+    if (window <= 0 || nowMicros() >= this->batchStart + window) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(this->batchMutex);
+    return !this->flushRequested && !this->closeRequested;
+}
+
+size_t EasySocket::getSendQueueDepth() {
+    return this->outgoing.size();
+}
+
+void EasySocket::updateState(SocketState next) {
+    if (this->state == next) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(this->batchMutex);
+    if (!this->closeRequested) {
+        this->state = next;
+    }
+}
+
+void EasySocket::pollSocket(easywsclient::WebSocket::pointer ws) {
+    if (this->wakePending) {
+        this->holdBatch();
+    }
+
+    this->writeQueued(ws);
+
+    // Sleep until there's something to read or write, or until send()/close()
+    // wakes us up. This keeps an idle connection from spinning a core.
+    ws->poll(-1);
+
+    this->readPolled(ws);
+}
+
+void EasySocket::serviceSocket(
+    easywsclient::WebSocket::pointer ws, bool& opened) {
+    switch (ws->getReadyState()) {
+    case easywsclient::WebSocket::CLOSING: {
+        this->updateState(SocketClosing);
+        break;
+    }
+    case easywsclient::WebSocket::CONNECTING: {
+        this->updateState(SocketConnecting);
+        break;
+    }
+    case easywsclient::WebSocket::OPEN: {
+        this->updateState(SocketOpen);
+        if (!opened) {
+            opened = true;
+            SocketDelegate* d = this->delegate;
+            if (d) {
+                d->webSocketDidOpen(this);
+            }
+        }
+        break;
+    }
+    default: { break; }
+    }
+
+    if (ws->getReadyState() != easywsclient::WebSocket::CLOSED) {
+        if (!this->wakePending || !this->isBatchHeld()) {
+            this->writeQueued(ws);
         }
+
+        // Reads and writes until the socket would block, which is what the
+        // edge triggered watch needs.
+        ws->poll(0);
+        this->readPolled(ws);
+    }
+
+    // The socket closed its descriptor, which took it out of epoll. Only
+    // the first service to see it reports it.
+    Reactor::WatchId id;
+    if (ws->getReadyState() == easywsclient::WebSocket::CLOSED
+        && (id = this->watchId.exchange(0))) {
+        this->state = SocketClosed;
+
+        // The watch is dropped only once the close is delivered, after any
+        // message queued before it. Until the loop releases it, it keeps
+        // the socket alive, so the task's reference is never the last and
+        // the socket isn't destroyed inside its own receiveQueue.
+        std::shared_ptr<EasySocket> self = this->shared_from_this();
+        this->receiveQueue.post([self, id]() {
+            SocketDelegate* d = self->delegate;
+            if (d) {
+                d->webSocketDidClose(self.get(), 0, "", true);
+            }
+            self->reactor->unwatch(id);
+        });
+    }
+}
+
+void EasySocket::writeQueued(easywsclient::WebSocket::pointer ws) {
+    // Take the batch. Sends from here on start the next one.
+    {
+        std::lock_guard<std::mutex> guard(this->batchMutex);
+        this->flushRequested = false;
+    }
+    this->wakePending.exchange(false);
+
+    // Hand everything queued so far to the socket, oldest first. It goes
+    // out in as few writes as the socket will take.
+    std::string message;
+    while (this->outgoing.pop(message)) {
+        ws->send(std::move(message));
+    }
+
+    // The PING carries its send time, which the PONG echoes back.
+    if (this->pingDue.exchange(false)) {
+        int64_t sentAt = nowMicros();
+        this->pingSentAt = sentAt;
+        ws->sendPing(std::to_string(sentAt));
+    }
+
+    if (this->closeRequested.exchange(false)) {
+        ws->close();
+    }
+}
+
+void EasySocket::readPolled(easywsclient::WebSocket::pointer ws) {
+    easywsclient::WebSocket::TxStats tx = ws->getTxStats();
+    this->framesSent = tx.frames;
+    this->writesMade = tx.writes;
+
+    ws->dispatch([this](std::string message) {
+        this->handleMessage(std::move(message));
     });
+    ws->dispatchPongs([this](std::string payload) {
+        this->handlePong(std::move(payload));
+    });
+}
+
+void EasySocket::handlePong(std::string payload) {
+    // Anything else is a PONG we didn't ask for, or are no longer waiting
+    // on. Taking the send time means a repeat isn't timed twice either.
+    char* end = nullptr;
+    int64_t sentAt = strtoll(payload.c_str(), &end, 10);
+    if (!payload.empty() && *end == '\0' && sentAt != 0
+        && this->pingSentAt.compare_exchange_strong(sentAt, 0)) {
+        int64_t rtt = nowMicros() - sentAt;
+        if (rtt >= 0) {
+            std::lock_guard<std::mutex> guard(this->pingMutex);
+            this->pingRtt.record(rtt);
+        }
+    }
+
+    this->receiveQueue.post(std::bind(
+        [this](std::string& payload) {
+            SocketDelegate* d = this->delegate;
+            if (d) {
+                d->webSocketDidReceivePong(this, payload);
+            }
+        },
+        std::move(payload)));
+}
+
+void EasySocket::handleMessage(std::string message) {
+    LOG(INFO) << message;
+    // Bind the message rather than capturing it so it is moved, not copied,
+    // into the queued task.
+    this->receiveQueue.post(std::bind(
+        [this](std::string& message) {
+            SocketDelegate* d = this->delegate;
+            if (d) {
+                d->webSocketDidReceive(this, std::move(message));
+            }
+        },
+        std::move(message)));
 }
 
 SocketState EasySocket::getSocketState() {
@@ -9,34 +9,220 @@
 #ifndef EasySocket_H
 #define EasySocket_H
 
+#include "MPSCQueue.h"
+#include "Reactor.h"
+#include "SerialExecutor.h"
 #include "SocketDelegate.h"
-#include "ThreadPool.h"
+#include "TimerWheel.h"
 #include "WebSocket.h"
 #include "easywsclient.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
 
-class EasySocket : public WebSocket {
+/**
+ *  EasySocket must be owned by a std::shared_ptr: its worker thread, or its
+ *  registration with the reactor, holds a reference so the object outlives
+ *  the connection it is servicing.
+ *
+ *  If the shared Reactor is running when an EasySocket is made, the reactor
+ *  services the socket and runs receiveQueue. Otherwise each connection gets
+ *  a worker thread that blocks in poll().
+ */
+class EasySocket : public WebSocket,
+                   public std::enable_shared_from_this<EasySocket> {
 private:
+    /*!< Services the socket and hosts receiveQueue, or nullptr if they have
+      threads of their own. */
+    Reactor* reactor;
+
     /*!< Queue used for receiving messages. */
-    ThreadPool receiveQueue;
+    SerialExecutor receiveQueue;
+
+    /*!< The socket's registration with reactor, 0 if none. */
+    std::atomic<Reactor::WatchId> watchId;
+
+    /*!< Messages queued by send(), written in order by the socket worker. */
+    MPSCQueue<std::string> outgoing;
+
+    /*!< Flag set by close() so the worker closes the socket on its thread. */
+    std::atomic<bool> closeRequested;
+
+    /*!< Set by the send that starts a batch and cleared by the worker as it
+      takes the batch, so a burst of sends wakes the worker once. */
+    std::atomic<bool> wakePending;
+
+    /*!< When the pending batch was started, in steady clock microseconds. */
+    std::atomic<int64_t> batchStart;
+
+    /*!< How long a batch is held open, in microseconds. 0 for no hold. */
+    std::atomic<int64_t> batchWindow;
+
+    /*!< Flag set by flush() to end the batch being held. */
+    bool flushRequested;
 
-    /*!< The mutex used when sending/polling messages over the socket. */
-    std::mutex socketMutex;
+    /*!< Guards flushRequested. Also taken to set closeRequested and to
+      change state, so a close can't be undone by updateState(). */
+    std::mutex batchMutex;
 
-    /*!< The underlying socket EasySocket wraps. */
-    easywsclient::WebSocket::pointer socket;
+    /*!< Wakes the worker out of a held batch. */
+    std::condition_variable batchWakeup;
+
+    /*!< Copied from the socket by the worker after every poll. */
+    std::atomic<uint64_t> framesSent;
+    std::atomic<uint64_t> writesMade;
+
+    /*!< Set by the ping timer so the worker sends a PING on its thread. */
+    std::atomic<bool> pingDue;
+
+    /*!< Send time of the PING awaiting its PONG, which it doubles as the
+      payload of, or 0 if none. Only the PONG carrying it is timed. */
+    std::atomic<int64_t> pingSentAt;
+
+    /*!< Periodic timer requesting PINGs, 0 if none. Guarded by pingMutex. */
+    TimerWheel::TimerId pingTimer;
+
+    /*!< Round trip times of answered PINGs. Guarded by pingMutex. */
+    LatencyHistogram pingRtt;
+
+    std::mutex pingMutex;
+
+    /*!< The underlying socket EasySocket wraps, nullptr if none.
+      The worker or watch servicing it holds a reference too, so it is only
+      freed once they are done with it, even if open() replaces it first.
+      Only read or written through std::atomic_load and friends. */
+    std::shared_ptr<easywsclient::WebSocket> socket;
 
     /*!< Keep track of Socket State.
       This is used instead of easywsclient's SocketState. */
-    SocketState state;
+    std::atomic<SocketState> state;
 
     /**
      *  \brief Function used to trigger WebSocket::webSocketDidReceive.
      *
-     *  \param message received.
+     *  \param message received, moved through to the delegate.
+     *  \return void
+     */
+    void handleMessage(std::string message);
+
+    /**
+     *  \brief Forgets the previous connection and takes on a new one.
+     *
+     *  \param socket The new connection, nullptr while it is being opened.
+     *  \return void
+     */
+    void resetConnection(std::shared_ptr<easywsclient::WebSocket> socket);
+
+    /**
+     *  \brief Has the socket serviced: interrupts the worker's poll, or
+     *  wakes the socket's watch on the reactor.
+     *
+     *  \param sock The socket being serviced.
+     *  \param delayUs Microseconds the reactor waits first. The worker
+     *  thread is always woken at once.
+     *  \return void
+     */
+    void wake(easywsclient::WebSocket::pointer sock, int64_t delayUs = 0);
+
+    /**
+     *  \brief Wakes the worker for a message just queued.
+     *
+     *  \param sock The socket the worker is servicing.
+     *  \return void
+     */
+    void wakeForSend(easywsclient::WebSocket::pointer sock);
+
+    /**
+     *  \brief Waits until the pending batch's window closes or it's flushed.
+     *
+     *  \return void
+     */
+    void holdBatch();
+
+    /**
+     *  \brief Whether the pending batch's window is still open. The
+     *  non-blocking counterpart of holdBatch().
+     *
+     *  \return bool
+     */
+    bool isBatchHeld();
+
+    /**
+     *  \brief Takes the pending batch and hands it to the socket, along with
+     *  any PING or close that is due.
+     *
+     *  \param ws The socket being serviced.
+     *  \return void
+     */
+    void writeQueued(easywsclient::WebSocket::pointer ws);
+
+    /**
+     *  \brief Picks up what the last poll did: its send counts, and the
+     *  frames it read.
+     *
+     *  \param ws The socket being serviced.
+     *  \return void
+     */
+    void readPolled(easywsclient::WebSocket::pointer ws);
+
+    /**
+     *  \brief Records the round trip of a PONG and passes it on.
+     *
+     *  Only a PONG answering the PING in flight is timed. Unsolicited ones,
+     *  and late ones for a PING already superseded or from an earlier
+     *  connection, are passed on but not recorded.
+     *
+     *  \param payload The PONG's payload, the PING's send time if it
+     *  answers one of ours.
      *  \return void
      */
-    void handleMessage(const std::string& message);
+    void handlePong(std::string payload);
+
+    /**
+     *  \brief Moves state along with the socket's ready state, unless
+     *  close() has been called and the worker hasn't acted on it yet.
+     *
+     *  close() reports the socket closed straight away, so a worker that
+     *  still sees it open mustn't report it open again.
+     *
+     *  \param next The state the socket is in.
+     *  \return void
+     */
+    void updateState(SocketState next);
+
+    /**
+     *  \brief Runs one iteration of the socket worker loop.
+     *
+     *  Hands queued messages to the socket, then sleeps until the socket is
+     *  readable/writable or woken up by send()/close().
+     *
+     *  \param ws The socket being serviced.
+     *  \return void
+     */
+    void pollSocket(easywsclient::WebSocket::pointer ws);
+
+    /**
+     *  \brief Services the socket on the reactor.
+     *
+     *  The reactor's counterpart of the worker loop. Never blocks: a batch
+     *  still inside its window is left for the wake due when it closes.
+     *
+     *  \param ws The socket being serviced.
+     *  \param opened Whether webSocketDidOpen has been called yet.
+     *  \return void
+     */
+    void serviceSocket(easywsclient::WebSocket::pointer ws, bool& opened);
+
+    /**
+     *  \brief Opens the connection on a thread of its own, then registers
+     *  it with the reactor.
+     *
+     *  \return void
+     */
+    void openOnReactor();
 
 public:
     // Make sure to implement this constructor if you take out the
@@ -44,10 +230,25 @@ public:
     // Otherwise, it'll throw `symbol not found` exceptions when compiling.
     EasySocket(const std::string& url, SocketDelegate* delegate);
 
+    ~EasySocket();
+
+    /**
+     *  \brief Number of messages sent but not yet handed to the socket.
+     *
+     *  \return size_t
+     */
+    size_t getSendQueueDepth();
+
     // WebSocket
     void open();
     void close();
     void send(const std::string& message);
+    void send(std::string&& message);
+    void setBatchWindow(int64_t us);
+    void flush();
+    SendStats getSendStats();
+    void setPingInterval(int ms);
+    LatencyHistogram getPingRtt();
     SocketState getSocketState();
     void setDelegate(SocketDelegate* delegate);
     SocketDelegate* getDelegate();
@@ -0,0 +1,107 @@
+#include "LatencyHistogram.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+/*!< log2 of HISTOGRAM_SUB_BUCKETS. */
+const int SUB_BITS = 3;
+
+/*!< Enough buckets for every uint64_t. */
+const size_t BUCKETS = HISTOGRAM_SUB_BUCKETS * (64 - SUB_BITS + 1);
+
+int log2Floor(uint64_t v) {
+    int bits = 0;
+    while (v >>= 1) {
+        bits++;
+    }
+
+    return bits;
+}
+
+} // namespace
+
+LatencyHistogram::LatencyHistogram()
+    : buckets(BUCKETS, 0) {
+    this->reset();
+}
+
+void LatencyHistogram::record(int64_t us) {
+    if (us < 0) {
+        us = 0;
+    }
+
+    this->buckets[bucketOf(static_cast<uint64_t>(us))]++;
+    this->min = this->count ? std::min(this->min, us) : us;
+    this->max = std::max(this->max, us);
+    this->sum += us;
+    this->count++;
+}
+
+void LatencyHistogram::reset() {
+    std::fill(this->buckets.begin(), this->buckets.end(), 0);
+    this->count = 0;
+    this->min = 0;
+    this->max = 0;
+    this->sum = 0;
+}
+
+uint64_t LatencyHistogram::getCount() const {
+    return this->count;
+}
+
+int64_t LatencyHistogram::getMin() const {
+    return this->min;
+}
+
+int64_t LatencyHistogram::getMax() const {
+    return this->max;
+}
+
+double LatencyHistogram::getMean() const {
+    return this->count ? this->sum / this->count : 0;
+}
+
+int64_t LatencyHistogram::percentile(double fraction) const {
+    if (!this->count) {
+        return 0;
+    }
+
+    uint64_t rank = static_cast<uint64_t>(
+        std::ceil(std::min(std::max(fraction, 0.0), 1.0) * this->count));
+    rank = std::max<uint64_t>(rank, 1);
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < this->buckets.size(); i++) {
+        seen += this->buckets[i];
+        if (seen >= rank) {
+            return std::min(upperBound(i), this->max);
+        }
+    }
+
+    return this->max;
+}
+
+size_t LatencyHistogram::bucketOf(uint64_t us) {
+    // Values below HISTOGRAM_SUB_BUCKETS get a bucket each. Past that, the
+    // top SUB_BITS bits under the leading one pick the bucket within its
+    // power of two.
+    if (us < HISTOGRAM_SUB_BUCKETS) {
+        return us;
+    }
+
+    int exponent = log2Floor(us);
+    size_t sub = (us >> (exponent - SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return HISTOGRAM_SUB_BUCKETS * (exponent - SUB_BITS + 1) + sub;
+}
+
+int64_t LatencyHistogram::upperBound(size_t bucket) {
+    if (bucket < HISTOGRAM_SUB_BUCKETS) {
+        return bucket;
+    }
+
+    int exponent = static_cast<int>(bucket / HISTOGRAM_SUB_BUCKETS) + SUB_BITS - 1;
+    uint64_t sub = bucket % HISTOGRAM_SUB_BUCKETS;
+    uint64_t top = ((HISTOGRAM_SUB_BUCKETS + sub + 1) << (exponent - SUB_BITS)) - 1;
+    return top > INT64_MAX ? INT64_MAX : static_cast<int64_t>(top);
+}
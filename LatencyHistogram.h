@@ -0,0 +1,86 @@
+/**
+ *   \file LatencyHistogram.h
+ *   \brief A fixed-size log-linear histogram of durations in microseconds.
+ *
+ *  Each power of two is split into HISTOGRAM_SUB_BUCKETS linear buckets,
+ *  so any value is kept to within about 12% whatever its magnitude, and
+ *  recording never allocates. This is a plain value: whoever shares one
+ *  across threads guards it, and hands out copies to read.
+ */
+#ifndef LatencyHistogram_H
+#define LatencyHistogram_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define HISTOGRAM_SUB_BUCKETS 8
+
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    /**
+     *  \brief Counts one duration.
+     *
+     *  \param us The duration in microseconds. Negative counts as 0.
+     *  \return void
+     */
+    void record(int64_t us);
+
+    /**
+     *  \brief Forgets everything recorded.
+     *
+     *  \return void
+     */
+    void reset();
+
+    /**
+     *  \brief Number of durations recorded.
+     *
+     *  \return uint64_t
+     */
+    uint64_t getCount() const;
+
+    /**
+     *  \brief Smallest duration recorded, exactly.
+     *
+     *  \return int64_t Microseconds, 0 if none.
+     */
+    int64_t getMin() const;
+
+    /**
+     *  \brief Largest duration recorded, exactly.
+     *
+     *  \return int64_t Microseconds, 0 if none.
+     */
+    int64_t getMax() const;
+
+    /**
+     *  \brief Mean of the durations recorded, exactly.
+     *
+     *  \return double Microseconds, 0 if none.
+     */
+    double getMean() const;
+
+    /**
+     *  \brief The duration below which fraction of those recorded fall.
+     *
+     *  \param fraction Between 0 and 1, e.g. 0.99 for p99.
+     *  \return int64_t Microseconds, the top of the bucket it falls in,
+     *  capped at getMax(). 0 if none.
+     */
+    int64_t percentile(double fraction) const;
+
+private:
+    std::vector<uint64_t> buckets;
+    uint64_t count;
+    int64_t min;
+    int64_t max;
+    double sum;
+
+    static size_t bucketOf(uint64_t us);
+    static int64_t upperBound(size_t bucket);
+};
+
+#endif // LatencyHistogram_H
@@ -0,0 +1,103 @@
+/**
+ *   \file MPSCQueue.h
+ *   \brief A lock-free multi-producer, single-consumer FIFO queue.
+ *
+ *  Producers never block or take a lock: push() is a single atomic exchange.
+ *  Only one thread may call pop(). This is Dmitry Vyukov's intrusive MPSC
+ *  node queue; a push that is still linking its node may be invisible to
+ *  pop() for a moment, so producers should wake the consumer after pushing.
+ */
+#ifndef MPSCQueue_H
+#define MPSCQueue_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+template <typename T>
+class MPSCQueue {
+private:
+    struct Node {
+        std::atomic<Node*> next;
+        T value;
+
+        Node()
+            : next(nullptr) {
+        }
+
+        explicit Node(T&& value)
+            : next(nullptr)
+            , value(std::move(value)) {
+        }
+    };
+
+    /*!< Most recently pushed node. Producers swap themselves in here. */
+    std::atomic<Node*> head;
+
+    /*!< Node before the oldest value. Only touched by the consumer. */
+    Node* tail;
+
+    /*!< Number of values pushed but not yet popped. */
+    std::atomic<size_t> count;
+
+public:
+    MPSCQueue()
+        : head(new Node())
+        , count(0) {
+        this->tail = this->head.load(std::memory_order_relaxed);
+    }
+
+    ~MPSCQueue() {
+        while (this->tail) {
+            Node* next = this->tail->next.load(std::memory_order_relaxed);
+            delete this->tail;
+            this->tail = next;
+        }
+    }
+
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+    /**
+     *  \brief Appends a value. Safe to call from any number of threads.
+     *
+     *  \param value The value to move into the queue.
+     *  \return void
+     */
+    void push(T value) {
+        Node* node = new Node(std::move(value));
+        this->count.fetch_add(1, std::memory_order_relaxed);
+        Node* prev = this->head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    /**
+     *  \brief Removes the oldest value. Only the consumer thread may call this.
+     *
+     *  \param value Receives the popped value.
+     *  \return bool Whether a value was popped.
+     */
+    bool pop(T& value) {
+        Node* next = this->tail->next.load(std::memory_order_acquire);
+        if (!next) {
+            return false;
+        }
+
+        value = std::move(next->value);
+        delete this->tail;
+        this->tail = next;
+        this->count.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     *  \brief Number of values currently queued.
+     *
+     *  \return size_t
+     */
+    size_t size() const {
+        return this->count.load(std::memory_order_relaxed);
+    }
+};
+
+#endif // MPSCQueue_H
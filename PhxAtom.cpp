@@ -0,0 +1,103 @@
+#include "PhxAtom.h"
+#include <functional>
+
+PhxAtoms& PhxAtoms::table() {
+    static PhxAtoms table;
+    return table;
+}
+
+PhxAtoms::PhxAtoms()
+    : current(nullptr) {
+    // In enum order, so the built-ins get their fixed values.
+    static const char* builtins[] = { "",
+        "phx_reply",
+        "phx_error",
+        "phx_close",
+        "phx_join",
+        "phx_leave",
+        "heartbeat",
+        "phoenix" };
+
+    Slots* slots = this->grow(PHX_ATOM_SLOTS);
+    for (PhxAtom atom = None; atom < BuiltinCount; atom++) {
+        std::string name = builtins[atom];
+        size_t hash = std::hash<std::string>()(name);
+        this->entries.push_back(Entry { name, hash, atom });
+        if (atom != None) {
+            insert(slots, &this->entries.back());
+        }
+    }
+}
+
+const PhxAtoms::Entry* PhxAtoms::find(
+    const Slots* slots, const std::string& name, size_t hash) {
+    for (size_t i = hash & slots->mask;; i = (i + 1) & slots->mask) {
+        const Entry* entry = slots->slots[i].load(std::memory_order_acquire);
+        if (!entry || (entry->hash == hash && entry->name == name)) {
+            return entry;
+        }
+    }
+}
+
+void PhxAtoms::insert(Slots* slots, const Entry* entry) {
+    size_t i = entry->hash & slots->mask;
+    while (slots->slots[i].load(std::memory_order_relaxed)) {
+        i = (i + 1) & slots->mask;
+    }
+
+    // Publishes the entry to lookups probing this table.
+    slots->slots[i].store(entry, std::memory_order_release);
+}
+
+PhxAtoms::Slots* PhxAtoms::grow(size_t size) {
+    std::unique_ptr<Slots> slots(new Slots);
+    slots->mask = size - 1;
+    slots->slots.reset(new std::atomic<const Entry*>[size]);
+    for (size_t i = 0; i < size; i++) {
+        slots->slots[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    for (const Entry& entry : this->entries) {
+        if (entry.atom != None) {
+            insert(slots.get(), &entry);
+        }
+    }
+
+    // The old table stays in tables: a lookup may still be probing it.
+    this->current.store(slots.get(), std::memory_order_release);
+    this->tables.push_back(std::move(slots));
+    return this->tables.back().get();
+}
+
+PhxAtom PhxAtoms::intern(const std::string& name) {
+    PhxAtoms& t = table();
+    size_t hash = std::hash<std::string>()(name);
+    std::lock_guard<std::mutex> guard(t.mutex);
+    Slots* slots = t.tables.back().get();
+    const Entry* entry = find(slots, name, hash);
+    if (entry) {
+        return entry->atom;
+    }
+
+    if ((t.entries.size() + 1) * 2 > slots->mask + 1) {
+        slots = t.grow((slots->mask + 1) * 2);
+    }
+
+    PhxAtom atom = static_cast<PhxAtom>(t.entries.size());
+    t.entries.push_back(Entry { name, hash, atom });
+    insert(slots, &t.entries.back());
+    return atom;
+}
+
+PhxAtom PhxAtoms::lookup(const std::string& name) {
+    const Slots* slots = table().current.load(std::memory_order_acquire);
+    const Entry* entry = find(slots, name, std::hash<std::string>()(name));
+    return entry ? entry->atom : None;
+}
+
+const std::string& PhxAtoms::name(PhxAtom atom) {
+    PhxAtoms& t = table();
+    std::lock_guard<std::mutex> guard(t.mutex);
+    return atom < t.entries.size() ? t.entries[atom].name
+                                   : t.entries[None].name;
+}
@@ -0,0 +1,132 @@
+/**
+ *   \file PhxAtom.h
+ *   \brief Process-wide interning of event and reply status names.
+ *
+ *  Channels intern the events they bind and pushes the statuses they wait
+ *  on, so dispatching a received message is one table lookup followed by
+ *  integer compares instead of string compares per binding. The built-in
+ *  Phoenix events and the "phoenix" topic are interned up front with fixed
+ *  values. Channel topics are not interned: they are as many as the
+ *  channels an application ever opens, so PhxSocket routes by the topic
+ *  string instead.
+ *
+ *  Atoms are never freed; a name keeps its atom for the life of the process.
+ *  That lets lookups of names off the wire probe the table without locking:
+ *  slots are only ever filled, and a table that is outgrown is kept rather
+ *  than freed, since a lookup may still be probing it. The table therefore
+ *  grows with the number of distinct event and status names the
+ *  application passes to on() and onReceive(), which is normally a fixed
+ *  set; the outgrown tables together are smaller than the current one.
+ *  Don't bind events named from unbounded data.
+ */
+#ifndef PhxAtom_H
+#define PhxAtom_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*!< Slots in the first atom table. A power of two. */
+#define PHX_ATOM_SLOTS 64
+
+/*!< Identifies an interned event or status name. */
+typedef uint32_t PhxAtom;
+
+class PhxAtoms {
+public:
+    /*!< Built-in names, interned before anything else. */
+    enum : PhxAtom {
+        None = 0,
+        PhxReply,
+        PhxError,
+        PhxClose,
+        PhxJoin,
+        PhxLeave,
+        Heartbeat,
+        Phoenix,
+        BuiltinCount
+    };
+
+    /**
+     *  \brief Gets the atom for name, interning it if it has none yet.
+     *
+     *  \param name The event or status name.
+     *  \return PhxAtom
+     */
+    static PhxAtom intern(const std::string& name);
+
+    /**
+     *  \brief Gets the atom for name without interning it.
+     *
+     *  Use this for names off the wire, so traffic nobody registered for
+     *  can't grow the table. Doesn't lock.
+     *
+     *  \param name The event or status name.
+     *  \return PhxAtom None if name was never interned.
+     */
+    static PhxAtom lookup(const std::string& name);
+
+    /**
+     *  \brief Gets the name an atom was interned from.
+     *
+     *  \param atom The atom.
+     *  \return const std::string& Empty for None or an unknown atom.
+     */
+    static const std::string& name(PhxAtom atom);
+
+    /**
+     *  \brief Whether atom is one of the phx_ lifecycle events.
+     *
+     *  \param atom The atom.
+     *  \return bool
+     */
+    static bool isLifecycle(PhxAtom atom) {
+        return atom >= PhxReply && atom <= PhxLeave;
+    }
+
+private:
+    /*!< An interned name. Never changes once it is in a table. */
+    struct Entry {
+        std::string name;
+        size_t hash;
+        PhxAtom atom;
+    };
+
+    /*!< Entries by name, open addressed and probed linearly. At most half
+      full, so a probe always ends at an empty slot. */
+    struct Slots {
+        size_t mask;
+        std::unique_ptr<std::atomic<const Entry*>[]> slots;
+    };
+
+    /*!< Entries by atom. A deque so entries, and the names handed out,
+      stay put. Guarded by mutex. */
+    std::deque<Entry> entries;
+
+    /*!< Every table made, the current one last. Guarded by mutex. */
+    std::vector<std::unique_ptr<Slots>> tables;
+
+    /*!< The table lookups probe. */
+    std::atomic<const Slots*> current;
+
+    /*!< Held while interning. */
+    std::mutex mutex;
+
+    PhxAtoms();
+
+    static PhxAtoms& table();
+
+    static const Entry* find(
+        const Slots* slots, const std::string& name, size_t hash);
+
+    static void insert(Slots* slots, const Entry* entry);
+
+    Slots* grow(size_t size);
+};
+
+#endif // PhxAtom_H
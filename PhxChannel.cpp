@@ -1,6 +1,7 @@
 #include "PhxChannel.h"
 #include "PhxPush.h"
 #include "PhxSocket.h"
+#include <algorithm>
 
 PhxChannel::PhxChannel(std::shared_ptr<PhxSocket> socket,
     const std::string& topic,
@@ -10,6 +11,7 @@ PhxChannel::PhxChannel(std::shared_ptr<PhxSocket> socket,
     this->params = params;
     this->socket = socket;
     this->joinedOnce = false;
+    this->dispatchDepth = 0;
 }
 
 void PhxChannel::bootstrap() {
@@ -21,22 +23,24 @@ void PhxChannel::bootstrap() {
 
     this->socket->onClose([this](const std::string& event) {
         this->state = ChannelState::CLOSED;
+        this->socket->holdOutbox(this->topic);
         this->socket->removeChannel(this->shared_from_this());
     });
 
-    this->socket->onError([this](
-        const std::string& error) { this->state = ChannelState::ERRORED; });
+    this->socket->onError([this](const std::string& error) {
+        this->state = ChannelState::ERRORED;
+        this->socket->holdOutbox(this->topic);
+    });
 
     std::shared_ptr<PhxPush> n = std::make_shared<PhxPush>(
         this->shared_from_this(), "phx_join", this->params);
     this->joinPush = std::move(n);
 
     this->joinPush->onReceive("ok",
-        [this](nlohmann::json message) { this->state = ChannelState::JOINED; });
-
-    this->onEvent("phx_reply", [this](nlohmann::json message, int64_t ref) {
-        this->triggerEvent(this->replyEventName(ref), message, ref);
-    });
+        [this](const nlohmann::json& message) {
+            this->state = ChannelState::JOINED;
+            this->socket->replayOutbox(this->topic, this->getJoinRef());
+        });
 }
 
 std::shared_ptr<PhxPush> PhxChannel::join() {
@@ -58,7 +62,10 @@ void PhxChannel::rejoin() {
 }
 
 void PhxChannel::sendJoin() {
+    // The socket drops its channels on close, so make sure we're routed to.
+    this->socket->addChannel(this->shared_from_this());
     this->state = ChannelState::JOINING;
+    this->socket->holdOutbox(this->topic);
     this->joinPush->setPayload(this->params);
     this->joinPush->send();
 }
@@ -67,36 +74,73 @@ void PhxChannel::leave() {
     this->state = ChannelState::CLOSED;
     nlohmann::json payload;
     this->pushEvent("phx_leave", payload)
-        ->onReceive("ok", [this](nlohmann::json message) {
-            this->triggerEvent("phx_close", "leave", -1);
+        ->onReceive("ok", [this](const nlohmann::json& message) {
+            this->triggerEvent(PhxAtoms::PhxClose, "leave", -1);
         });
 }
 
 void PhxChannel::onClose(OnClose callback) {
-    this->onEvent(
-        "phx_close", [this, callback](nlohmann::json message, int64_t ref) {
+    this->onEvent("phx_close",
+        [callback](const nlohmann::json& message, int64_t ref) {
             callback(message);
         });
 }
 
 void PhxChannel::onError(OnError callback) {
     this->onEvent("phx_error",
-        [callback](nlohmann::json error, int64_t ref) { callback(error); });
+        [callback](const nlohmann::json& error, int64_t ref) {
+            callback(error);
+        });
 }
 
 void PhxChannel::onEvent(const std::string& event, OnReceive callback) {
-    this->bindings.emplace_back(event, callback);
+    Binding binding;
+    binding.callback = std::move(callback);
+    binding.removed = false;
+    this->bindings[PhxAtoms::intern(event)].push_back(std::move(binding));
+}
+
+bool PhxChannel::hasBinding(PhxAtom event) {
+    return this->bindings.find(event) != this->bindings.end();
 }
 
 void PhxChannel::offEvent(const std::string& event) {
-    // Remove all Event bindings that match event.
-    std::vector<std::tuple<std::string, OnReceive>> v = this->bindings;
-    v.erase(std::remove_if(v.begin(),
-                v.end(),
-                [this, event](std::tuple<std::string, OnReceive> x) {
-                    return std::get<0>(x) == event;
-                }),
-        v.end());
+    auto it = this->bindings.find(PhxAtoms::lookup(event));
+    if (it == this->bindings.end()) {
+        return;
+    }
+
+    if (this->dispatchDepth == 0) {
+        this->bindings.erase(it);
+        return;
+    }
+
+    // A callback for this event may be running, so only mark them.
+    for (Binding& binding : it->second) {
+        binding.removed = true;
+    }
+
+    this->removedEvents.push_back(it->first);
+}
+
+void PhxChannel::eraseRemoved() {
+    for (PhxAtom event : this->removedEvents) {
+        auto it = this->bindings.find(event);
+        if (it == this->bindings.end()) {
+            continue;
+        }
+
+        std::deque<Binding>& list = it->second;
+        list.erase(std::remove_if(list.begin(),
+                       list.end(),
+                       [](const Binding& binding) { return binding.removed; }),
+            list.end());
+        if (list.empty()) {
+            this->bindings.erase(it);
+        }
+    }
+
+    this->removedEvents.clear();
 }
 
 bool PhxChannel::isMemberOfTopic(const std::string& topic) {
@@ -104,21 +148,57 @@ bool PhxChannel::isMemberOfTopic(const std::string& topic) {
 }
 
 void PhxChannel::triggerEvent(
-    const std::string& event, nlohmann::json message, int64_t ref) {
-    // Trigger OnReceive callbacks that match event.
-    std::vector<std::tuple<std::string, OnReceive>> v = this->bindings;
-    for (std::tuple<std::string, OnReceive>& it : v) {
-        if (std::get<0>(it) == event) {
-            std::get<1>(it)(message, ref);
+    const std::string& event, const nlohmann::json& message, int64_t ref) {
+    // An event nobody interned can't have bindings.
+    PhxAtom atom = PhxAtoms::lookup(event);
+    if (atom != PhxAtoms::None) {
+        this->triggerEvent(atom, message, ref);
+    }
+}
+
+void PhxChannel::triggerEvent(
+    PhxAtom event, const nlohmann::json& message, int64_t ref) {
+    auto it = this->bindings.find(event);
+    if (it == this->bindings.end()) {
+        return;
+    }
+
+    // References into the map and deque stay valid while callbacks add
+    // bindings, and removals are deferred until dispatch unwinds. Bindings
+    // added by a callback don't see this message.
+    std::deque<Binding>& list = it->second;
+    this->dispatchDepth++;
+    for (size_t i = 0, n = list.size(); i < n; i++) {
+        if (!list[i].removed) {
+            list[i].callback(message, ref);
         }
     }
+    this->dispatchDepth--;
+
+    if (this->dispatchDepth == 0 && !this->removedEvents.empty()) {
+        this->eraseRemoved();
+    }
 }
 
 std::shared_ptr<PhxPush> PhxChannel::pushEvent(
     const std::string& event,
     nlohmann::json payload) {
-    std::shared_ptr<PhxPush> p
-        = std::make_shared<PhxPush>(this->shared_from_this(), event, payload);
+    std::shared_ptr<PhxPush> p = std::make_shared<PhxPush>(
+        this->shared_from_this(), event, std::move(payload));
+    p->send();
+    return p;
+}
+
+std::shared_ptr<PhxPush> PhxChannel::pushRaw(
+    const std::string& event, std::string&& payload) {
+    return this->pushRaw(
+        event, std::make_shared<const std::string>(std::move(payload)));
+}
+
+std::shared_ptr<PhxPush> PhxChannel::pushRaw(
+    const std::string& event, std::shared_ptr<const std::string> payload) {
+    std::shared_ptr<PhxPush> p = std::make_shared<PhxPush>(
+        this->shared_from_this(), event, std::move(payload));
     p->send();
     return p;
 }
@@ -127,12 +207,10 @@ std::shared_ptr<PhxSocket> PhxChannel::getSocket() {
     return this->socket;
 }
 
-std::string PhxChannel::replyEventName(int64_t ref) {
-    std::string text = "chan_reply_";
-    text += std::to_string(ref);
-    return text;
+int64_t PhxChannel::getJoinRef() {
+    return this->joinPush ? this->joinPush->getRef() : -1;
 }
 
-std::string PhxChannel::getTopic() {
+const std::string& PhxChannel::getTopic() {
     return this->topic;
 }
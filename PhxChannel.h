@@ -8,10 +8,13 @@
 #ifndef PhxChannel_H
 #define PhxChannel_H
 
+#include "PhxAtom.h"
 #include "PhxTypes.h"
+#include <deque>
 #include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 class PhxSocket;
@@ -26,11 +29,25 @@ public:
 
 class PhxChannel : public std::enable_shared_from_this<PhxChannel> {
 private:
+    struct Binding {
+        OnReceive callback;
+
+        /*!< Set by offEvent while dispatching; erased once dispatch ends. */
+        bool removed;
+    };
+
     /*!<
-     * bindings contains a list of tuples where Item 1 is the Event
-     * and Item 2 is the callback.
+     * bindings maps each Event's atom to its callbacks, in the order they
+     * were added. A deque so references survive bindings added
+     * mid-dispatch.
      */
-    std::vector<std::tuple<std::string, OnReceive>> bindings;
+    std::unordered_map<PhxAtom, std::deque<Binding>> bindings;
+
+    /*!< How many triggerEvent calls are on the stack. */
+    int dispatchDepth;
+
+    /*!< Events with bindings marked removed during dispatch. */
+    std::vector<PhxAtom> removedEvents;
 
     /*!< A flag indicating whether there has been an attempt to join channel. */
     bool joinedOnce;
@@ -75,32 +92,45 @@ private:
      */
     bool isMemberOfTopic(const std::string& topic);
 
+    /**
+     *  \brief Erases bindings offEvent marked while dispatching.
+     *
+     *  \return void
+     */
+    void eraseRemoved();
+
 public:
     /**
      *  \brief Trigger callbacks that match event.
      *
+     *  Every callback is handed the same message, which it must copy if it
+     *  wants to keep it.
+     *
      *  \param event The event to trigger callbacks for.
      *  \param message The message to forward to callback.
      *  \param ref The ref of the message.
      *  \return void
      */
     void triggerEvent(
-        const std::string& event, nlohmann::json message, int64_t ref);
+        const std::string& event, const nlohmann::json& message, int64_t ref);
 
     /**
-     *  \brief Getter for socket.
+     *  \brief Trigger callbacks that match an interned event.
      *
-     *  \return std::shared_ptr<PhxSocket>
+     *  \param event The event's atom.
+     *  \param message The message to forward to callback.
+     *  \param ref The ref of the message.
+     *  \return void
      */
-    std::shared_ptr<PhxSocket> getSocket();
+    void triggerEvent(
+        PhxAtom event, const nlohmann::json& message, int64_t ref);
 
     /**
-     *  \brief Creates a event named for a reply using ref.
+     *  \brief Getter for socket.
      *
-     *  \param ref Phoenix ref.
-     *  \return std::string
+     *  \return std::shared_ptr<PhxSocket>
      */
-    std::string replyEventName(int64_t ref);
+    std::shared_ptr<PhxSocket> getSocket();
 
     /**
      *  \brief Constructor
@@ -156,11 +186,20 @@ public:
      */
     void onEvent(const std::string& event, OnReceive callback);
 
+    /**
+     *  \brief Whether any callback is bound to event.
+     *
+     *  \param event The event's atom.
+     *  \return bool
+     */
+    bool hasBinding(PhxAtom event);
+
     /**
      *  \brief Removes event from this->bindings.
      *
      *  Removing event from bindings skips any callback associated with that
-     *  event from triggering.
+     *  event from triggering. This is safe from inside a callback, including
+     *  the one being removed.
      *
      *  \param event The event to unsubscribe.
      *  \return void
@@ -193,12 +232,44 @@ public:
     std::shared_ptr<PhxPush> pushEvent(
         const std::string& event, nlohmann::json payload);
 
+    /**
+     *  \brief Pushes an event whose payload is already serialized.
+     *
+     *  The payload is spliced into the envelope as is, never parsed, so it
+     *  must be valid JSON. Replies and timeouts work as for pushEvent.
+     *
+     *  \param event The event to push to server.
+     *  \param payload The payload's JSON text, moved in.
+     *  \return std::shared_ptr<PhxPush>
+     */
+    std::shared_ptr<PhxPush> pushRaw(
+        const std::string& event, std::string&& payload);
+
+    /**
+     *  \brief Pushes an event whose payload is already serialized.
+     *
+     *  Lets one payload be relayed to several channels without copying it.
+     *
+     *  \param event The event to push to server.
+     *  \param payload The payload's JSON text, shared with the caller.
+     *  \return std::shared_ptr<PhxPush>
+     */
+    std::shared_ptr<PhxPush> pushRaw(
+        const std::string& event, std::shared_ptr<const std::string> payload);
+
+    /**
+     *  \brief The ref of the channel's latest join.
+     *
+     *  \return int64_t -1 if it hasn't joined.
+     */
+    int64_t getJoinRef();
+
     /**
      *  \brief Gets the topic of the channel.
      *
-     *  \return std::string topic
+     *  \return const std::string& topic
      */
-    std::string getTopic();
+    const std::string& getTopic();
 };
 
 #endif
@@ -0,0 +1,426 @@
+#include "PhxEnvelope.h"
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+const char* skipSpace(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) {
+        p++;
+    }
+
+    return p;
+}
+
+/*!< Bytes skipValue has to stop at inside an object or array. */
+struct StructuralTable {
+    bool table[256];
+
+    StructuralTable() {
+        memset(this->table, 0, sizeof(this->table));
+        this->table['"'] = true;
+        this->table['{'] = true;
+        this->table['}'] = true;
+        this->table['['] = true;
+        this->table[']'] = true;
+    }
+
+    bool operator[](unsigned char c) const {
+        return this->table[c];
+    }
+};
+
+const StructuralTable structural;
+
+template <size_t N>
+bool keyIs(const char* key, size_t length, const char (&name)[N]) {
+    return length == N - 1 && memcmp(key, name, N - 1) == 0;
+}
+
+/**
+ *  \brief Finds the quote closing a string.
+ *
+ *  \param p Just past the opening quote.
+ *  \param end End of the text.
+ *  \return const char* The closing quote, nullptr if there isn't one.
+ */
+const char* findQuote(const char* p, const char* end) {
+    while (p < end) {
+        const char* q = static_cast<const char*>(memchr(p, '"', end - p));
+        if (!q) {
+            return nullptr;
+        }
+
+        // The quote is escaped if an odd number of backslashes precede it.
+        const char* b = q;
+        while (b > p && b[-1] == '\\') {
+            b--;
+        }
+
+        if ((q - b) % 2 == 0) {
+            return q;
+        }
+
+        p = q + 1;
+    }
+
+    return nullptr;
+}
+
+void appendUtf8(std::string& out, uint32_t c) {
+    if (c < 0x80) {
+        out += static_cast<char>(c);
+    } else if (c < 0x800) {
+        out += static_cast<char>(0xc0 | (c >> 6));
+        out += static_cast<char>(0x80 | (c & 0x3f));
+    } else if (c < 0x10000) {
+        out += static_cast<char>(0xe0 | (c >> 12));
+        out += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (c & 0x3f));
+    } else {
+        out += static_cast<char>(0xf0 | (c >> 18));
+        out += static_cast<char>(0x80 | ((c >> 12) & 0x3f));
+        out += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (c & 0x3f));
+    }
+}
+
+bool readHex4(const char* p, const char* end, uint32_t& value) {
+    if (end - p < 4) {
+        return false;
+    }
+
+    value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value |= c - 'A' + 10;
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ *  \brief Decodes a JSON string.
+ *
+ *  \param p The opening quote.
+ *  \param end End of the text.
+ *  \param out Receives the unescaped string.
+ *  \return const char* Just past the closing quote, nullptr on error.
+ */
+const char* readString(const char* p, const char* end, std::string& out) {
+    if (*p != '"') {
+        return nullptr;
+    }
+
+    const char* q = findQuote(p + 1, end);
+    if (!q) {
+        return nullptr;
+    }
+
+    const char* s = p + 1;
+    const char* slash = static_cast<const char*>(memchr(s, '\\', q - s));
+    if (!slash) {
+        out.assign(s, q);
+        return q + 1;
+    }
+
+    out.assign(s, slash);
+    for (s = slash; s < q; s++) {
+        if (*s != '\\') {
+            out += *s;
+            continue;
+        }
+
+        s++;
+        switch (*s) {
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+            uint32_t c;
+            if (!readHex4(s + 1, q, c)) {
+                return nullptr;
+            }
+            s += 4;
+
+            // A high surrogate should be followed by \u and a low one.
+            uint32_t low;
+            if (c >= 0xd800 && c < 0xdc00 && q - s > 6 && s[1] == '\\'
+                && s[2] == 'u' && readHex4(s + 3, q, low) && low >= 0xdc00
+                && low < 0xe000) {
+                c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+                s += 6;
+            }
+
+            appendUtf8(out, c);
+            break;
+        }
+        default: out += *s; break;
+        }
+    }
+
+    return q + 1;
+}
+
+/**
+ *  \brief Skips over any JSON value without decoding it.
+ *
+ *  \param p The first character of the value.
+ *  \param end End of the text.
+ *  \return const char* Just past the value, nullptr on error.
+ */
+const char* skipValue(const char* p, const char* end) {
+    if (*p == '"') {
+        const char* q = findQuote(p + 1, end);
+        return q ? q + 1 : nullptr;
+    }
+
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        while (p < end) {
+            // Most bytes are neither quotes nor brackets, so skip them in
+            // a tight loop before looking at what we stopped on.
+            while (p < end && !structural[static_cast<unsigned char>(*p)]) {
+                p++;
+            }
+
+            if (p == end) {
+                break;
+            }
+
+            char c = *p;
+            if (c == '"') {
+                const char* q = findQuote(p + 1, end);
+                if (!q) {
+                    return nullptr;
+                }
+
+                p = q + 1;
+                continue;
+            }
+
+            if (c == '{' || c == '[') {
+                depth++;
+            } else if ((c == '}' || c == ']') && --depth == 0) {
+                return p + 1;
+            }
+
+            p++;
+        }
+
+        return nullptr;
+    }
+
+    // A number, true, false or null.
+    const char* start = p;
+    while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' '
+        && *p != '\n' && *p != '\r' && *p != '\t') {
+        p++;
+    }
+
+    return p == start ? nullptr : p;
+}
+
+/**
+ *  \brief Reads a ref, which may be null, a number or a numeric string.
+ *
+ *  \param p The first character of the value.
+ *  \param end End of the text.
+ *  \param ref Receives the ref, -1 if it isn't a number or doesn't fit in
+ *  an int64_t.
+ *  \return const char* Just past the value, nullptr on error.
+ */
+const char* readRef(const char* p, const char* end, int64_t& ref) {
+    const char* next = skipValue(p, end);
+    if (!next) {
+        return nullptr;
+    }
+
+    const char* s = p;
+    const char* e = next;
+    if (*s == '"') {
+        s++;
+        e--;
+    }
+
+    ref = -1;
+    if (s == e) {
+        return next;
+    }
+
+    int64_t value = 0;
+    for (const char* d = s; d < e; d++) {
+        if (*d < '0' || *d > '9') {
+            return next;
+        }
+
+        // Refs come off the wire, so one too big must miss, not overflow.
+        int digit = *d - '0';
+        if (value > (INT64_MAX - digit) / 10) {
+            return next;
+        }
+
+        value = value * 10 + digit;
+    }
+
+    ref = value;
+    return next;
+}
+
+} // namespace
+
+PhxEnvelope::PhxEnvelope() {
+    this->raw = nullptr;
+    this->payloadOffset = 0;
+    this->payloadLength = 0;
+    this->ref = -1;
+    this->joinRef = -1;
+}
+
+bool PhxEnvelope::scan(const std::string& raw) {
+    this->raw = &raw;
+    this->payloadOffset = 0;
+    this->payloadLength = 0;
+    this->ref = -1;
+    this->joinRef = -1;
+
+    const char* begin = raw.data();
+    const char* end = begin + raw.size();
+    const char* p = skipSpace(begin, end);
+    if (p != end && *p == '[') {
+        return this->scanArray(p + 1, end);
+    }
+
+    if (p == end || *p != '{') {
+        return false;
+    }
+
+    bool sawTopic = false;
+    bool sawEvent = false;
+    for (p++;;) {
+        p = skipSpace(p, end);
+        if (p == end || *p != '"') {
+            return false;
+        }
+
+        const char* key = p + 1;
+        const char* keyEnd = findQuote(key, end);
+        if (!keyEnd) {
+            return false;
+        }
+
+        size_t length = keyEnd - key;
+        p = skipSpace(keyEnd + 1, end);
+        if (p == end || *p != ':') {
+            return false;
+        }
+
+        p = skipSpace(p + 1, end);
+        if (p == end) {
+            return false;
+        }
+
+        if (keyIs(key, length, "topic")) {
+            p = readString(p, end, this->topic);
+            sawTopic = true;
+        } else if (keyIs(key, length, "event")) {
+            p = readString(p, end, this->event);
+            sawEvent = true;
+        } else if (keyIs(key, length, "ref")) {
+            p = readRef(p, end, this->ref);
+        } else if (keyIs(key, length, "join_ref")) {
+            p = readRef(p, end, this->joinRef);
+        } else if (keyIs(key, length, "payload")) {
+            const char* start = p;
+            p = skipValue(p, end);
+            if (p) {
+                this->payloadOffset = start - begin;
+                this->payloadLength = p - start;
+            }
+        } else {
+            p = skipValue(p, end);
+        }
+
+        if (!p) {
+            return false;
+        }
+
+        p = skipSpace(p, end);
+        if (p == end) {
+            return false;
+        }
+
+        if (*p == '}') {
+            break;
+        }
+
+        if (*p != ',') {
+            return false;
+        }
+
+        p++;
+    }
+
+    return sawTopic && sawEvent;
+}
+
+// Private
+
+bool PhxEnvelope::scanArray(const char* p, const char* end) {
+    const char* begin = this->raw->data();
+
+    // [join_ref, ref, topic, event, payload]
+    for (int i = 0; i < 5; i++) {
+        p = skipSpace(p, end);
+        if (p == end) {
+            return false;
+        }
+
+        const char* start = p;
+        switch (i) {
+        case 0: p = readRef(p, end, this->joinRef); break;
+        case 1: p = readRef(p, end, this->ref); break;
+        case 2: p = readString(p, end, this->topic); break;
+        case 3: p = readString(p, end, this->event); break;
+        default: p = skipValue(p, end); break;
+        }
+
+        if (!p) {
+            return false;
+        }
+
+        if (i == 4) {
+            this->payloadOffset = start - begin;
+            this->payloadLength = p - start;
+        }
+
+        p = skipSpace(p, end);
+        if (p == end || *p != (i == 4 ? ']' : ',')) {
+            return false;
+        }
+
+        p++;
+    }
+
+    return true;
+}
+
+nlohmann::json PhxEnvelope::getPayload() const {
+    if (this->payloadLength == 0) {
+        return nullptr;
+    }
+
+    const char* start = this->raw->data() + this->payloadOffset;
+    return nlohmann::json::parse(start, start + this->payloadLength);
+}
@@ -0,0 +1,76 @@
+/**
+ *   \file PhxEnvelope.h
+ *   \brief The routing fields of a Phoenix message, scanned without a DOM.
+ *
+ *  PhxSocket only needs topic, event and ref to decide where a message goes.
+ *  PhxEnvelope::scan walks the raw text once, decoding those and recording
+ *  where the payload sits, so the payload is only parsed by
+ *  PhxEnvelope::getPayload when something actually wants it. Traffic nobody
+ *  listens to is dropped after a single pass over its bytes.
+ */
+#ifndef PhxEnvelope_H
+#define PhxEnvelope_H
+
+#include "PhxTypes.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class PhxEnvelope {
+private:
+    /*!< The text scan() was given. Must outlive this envelope. */
+    const std::string* raw;
+
+    /*!< Where the payload's JSON text starts in raw. */
+    size_t payloadOffset;
+
+    /*!< Length of the payload's JSON text, 0 if there was no payload. */
+    size_t payloadLength;
+
+    /**
+     *  \brief Scans the body of a V2 [join_ref, ref, topic, event, payload]
+     *  array.
+     *
+     *  \param p Just past the opening bracket.
+     *  \param end End of the text.
+     *  \return bool False if malformed.
+     */
+    bool scanArray(const char* p, const char* end);
+
+public:
+    /*!< The message topic. */
+    std::string topic;
+
+    /*!< The message event. */
+    std::string event;
+
+    /*!< The message ref, -1 if null or missing. */
+    int64_t ref;
+
+    /*!< The ref of the join this message belongs to, -1 if null or missing.
+     */
+    int64_t joinRef;
+
+    PhxEnvelope();
+
+    /**
+     *  \brief Scans a serialized message.
+     *
+     *  Accepts both the V1 object and the V2 array envelope. Only the
+     *  envelope's structure is checked; the payload is skipped over, not
+     *  validated.
+     *
+     *  \param raw The message text. Must outlive this envelope.
+     *  \return bool False if raw isn't a Phoenix message.
+     */
+    bool scan(const std::string& raw);
+
+    /**
+     *  \brief Parses the payload recorded by scan.
+     *
+     *  \return nlohmann::json The payload, null if there was none.
+     */
+    nlohmann::json getPayload() const;
+};
+
+#endif // PhxEnvelope_H
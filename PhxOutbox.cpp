@@ -0,0 +1,147 @@
+#include "PhxOutbox.h"
+
+PhxOutbox::PhxOutbox()
+    : capacity(0)
+    , ttl(0)
+    , policy(OutboxPolicy::DropOldest)
+    , depth(0)
+    , blockedCount(0)
+    , dropped(0)
+    , enabled(false) {
+}
+
+void PhxOutbox::configure(size_t capacity, int ttlMs, OutboxPolicy policy) {
+    std::lock_guard<std::mutex> guard(this->mutex);
+    this->capacity = capacity;
+    this->ttl = std::chrono::milliseconds(ttlMs > 0 ? ttlMs : 0);
+    this->policy = policy;
+    this->enabled = capacity > 0;
+}
+
+bool PhxOutbox::isEnabled() {
+    return this->enabled;
+}
+
+void PhxOutbox::push(const std::string& topic,
+    const std::string& event,
+    std::string&& payload,
+    int64_t ref,
+    std::vector<int64_t>& dropped) {
+    std::chrono::steady_clock::time_point now
+        = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> guard(this->mutex);
+    this->expire(now, dropped);
+
+    if (this->messages.size() >= this->capacity) {
+        if (this->policy == OutboxPolicy::DropNewest
+            || this->capacity == 0) {
+            this->dropped++;
+            dropped.push_back(ref);
+            return;
+        }
+
+        while (this->messages.size() >= this->capacity) {
+            dropped.push_back(this->messages.front().ref);
+            this->messages.pop_front();
+            this->dropped++;
+        }
+    }
+
+    Message message;
+    message.topic = topic;
+    message.event = event;
+    message.payload = std::move(payload);
+    message.ref = ref;
+    message.expiry = this->ttl.count() > 0
+        ? now + this->ttl
+        : std::chrono::steady_clock::time_point::max();
+    this->messages.push_back(std::move(message));
+    this->depth = this->messages.size();
+}
+
+void PhxOutbox::block(const std::string& topic) {
+    std::lock_guard<std::mutex> guard(this->mutex);
+    this->blocked.insert(topic);
+    this->blockedCount = this->blocked.size();
+}
+
+bool PhxOutbox::holds(const std::string& topic) {
+    if (this->depth == 0 && this->blockedCount == 0) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(this->mutex);
+    if (this->blocked.count(topic) > 0) {
+        return true;
+    }
+
+    for (const Message& message : this->messages) {
+        if (message.topic == topic) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void PhxOutbox::replay(const std::string& topic,
+    const std::function<void(const Message&)>& send,
+    std::vector<int64_t>& expired) {
+    if (this->depth == 0 && this->blockedCount == 0) {
+        return;
+    }
+
+    std::chrono::steady_clock::time_point now
+        = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> guard(this->mutex);
+    this->blocked.erase(topic);
+    this->blockedCount = this->blocked.size();
+
+    std::deque<Message> kept;
+    for (Message& message : this->messages) {
+        if (message.topic != topic) {
+            kept.push_back(std::move(message));
+        } else if (message.expiry <= now) {
+            expired.push_back(message.ref);
+            this->dropped++;
+        } else {
+            send(message);
+        }
+    }
+
+    this->messages.swap(kept);
+    this->depth = this->messages.size();
+}
+
+std::vector<int64_t> PhxOutbox::getRefs() {
+    std::vector<int64_t> refs;
+    std::lock_guard<std::mutex> guard(this->mutex);
+    for (const Message& message : this->messages) {
+        refs.push_back(message.ref);
+    }
+
+    return refs;
+}
+
+size_t PhxOutbox::size() {
+    return this->depth;
+}
+
+uint64_t PhxOutbox::getDropped() {
+    return this->dropped;
+}
+
+void PhxOutbox::expire(std::chrono::steady_clock::time_point now,
+    std::vector<int64_t>& expired) {
+    // Messages are pushed in expiry order unless the TTL is changed, and
+    // replay checks every message anyway, so the front is enough.
+    while (!this->messages.empty() && this->messages.front().expiry <= now) {
+        expired.push_back(this->messages.front().ref);
+        this->messages.pop_front();
+        this->dropped++;
+    }
+
+    this->depth = this->messages.size();
+}
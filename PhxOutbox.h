@@ -0,0 +1,180 @@
+/**
+ *   \file PhxOutbox.h
+ *   \brief A bounded queue of pushes made while the socket is down.
+ *
+ *  PhxSocket parks a channel's pushes here while it can't send them, either
+ *  because the socket is down or because the channel hasn't rejoined yet,
+ *  and replays them in order, re-stamped with the new join_ref, once the
+ *  channel has rejoined. The queue is bounded: when full, either the oldest message
+ *  or the one being added is dropped. Messages older than the TTL are
+ *  dropped instead of replayed. Payloads are kept as JSON text, so replay
+ *  doesn't have to serialize them again.
+ *
+ *  All methods are thread safe.
+ */
+#ifndef PhxOutbox_H
+#define PhxOutbox_H
+
+#include "PhxTypes.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+class PhxOutbox {
+public:
+    struct Message {
+        std::string topic;
+        std::string event;
+
+        /*!< The payload's JSON text. */
+        std::string payload;
+
+        /*!< The ref the push was made with, which its reply will carry. */
+        int64_t ref;
+
+        /*!< When the message is dropped instead of replayed. */
+        std::chrono::steady_clock::time_point expiry;
+    };
+
+    PhxOutbox();
+
+    /**
+     *  \brief Sets the outbox's limits. Messages already held are kept.
+     *
+     *  \param capacity Messages held at most, 0 to turn the outbox off.
+     *  \param ttlMs Milliseconds a message is held at most, 0 for no limit.
+     *  \param policy Which message to drop when full.
+     *  \return void
+     */
+    void configure(size_t capacity, int ttlMs, OutboxPolicy policy);
+
+    /**
+     *  \brief Whether the outbox holds messages at all.
+     *
+     *  \return bool
+     */
+    bool isEnabled();
+
+    /**
+     *  \brief Holds a message until its topic is replayed.
+     *
+     *  \param topic The topic.
+     *  \param event The event.
+     *  \param payload The payload's JSON text, moved in.
+     *  \param ref The ref of the message.
+     *  \param dropped Gets the refs of messages dropped to make room, which
+     *  may include this one, and of expired messages.
+     *  \return void
+     */
+    void push(const std::string& topic,
+        const std::string& event,
+        std::string&& payload,
+        int64_t ref,
+        std::vector<int64_t>& dropped);
+
+    /**
+     *  \brief Holds everything pushed to topic until it is replayed.
+     *
+     *  For a channel that is joining: the socket may be open, but the
+     *  server would reject pushes made under the old join_ref.
+     *
+     *  \param topic The topic.
+     *  \return void
+     */
+    void block(const std::string& topic);
+
+    /**
+     *  \brief Whether topic is blocked or has messages waiting to be
+     *  replayed.
+     *
+     *  Anything pushed to topic meanwhile has to wait behind them.
+     *
+     *  \param topic The topic.
+     *  \return bool
+     */
+    bool holds(const std::string& topic);
+
+    /**
+     *  \brief Removes topic's messages and hands them to send, oldest first.
+     *
+     *  Unblocks topic.
+     *
+     *  send is called under the outbox's lock, so a message pushed meanwhile
+     *  can't overtake them. It must not call back into the outbox.
+     *
+     *  \param topic The topic to replay.
+     *  \param send Called for each message still within its TTL.
+     *  \param expired Gets the refs of messages dropped for their TTL.
+     *  \return void
+     */
+    void replay(const std::string& topic,
+        const std::function<void(const Message&)>& send,
+        std::vector<int64_t>& expired);
+
+    /**
+     *  \brief Refs of every message held.
+     *
+     *  \return std::vector<int64_t>
+     */
+    std::vector<int64_t> getRefs();
+
+    /**
+     *  \brief Number of messages held.
+     *
+     *  \return size_t
+     */
+    size_t size();
+
+    /**
+     *  \brief Messages dropped so far, whether for room or for their TTL.
+     *
+     *  \return uint64_t
+     */
+    uint64_t getDropped();
+
+private:
+    /*!< Held messages, oldest first. */
+    std::deque<Message> messages;
+
+    size_t capacity;
+
+    /*!< 0 for no limit. */
+    std::chrono::milliseconds ttl;
+
+    OutboxPolicy policy;
+
+    /*!< Topics held until replayed, whether or not they have messages. */
+    std::unordered_set<std::string> blocked;
+
+    /*!< Mirrors messages.size() so holds() needn't lock when empty. */
+    std::atomic<size_t> depth;
+
+    /*!< Mirrors blocked.size(), likewise. */
+    std::atomic<size_t> blockedCount;
+
+    std::atomic<uint64_t> dropped;
+
+    /*!< Whether capacity is non-zero, readable without the lock. */
+    std::atomic<bool> enabled;
+
+    std::mutex mutex;
+
+    /**
+     *  \brief Drops expired messages off the front. Call with mutex held.
+     *
+     *  \param now The current time.
+     *  \param expired Gets the refs of the dropped messages.
+     *  \return void
+     */
+    void expire(std::chrono::steady_clock::time_point now,
+        std::vector<int64_t>& expired);
+};
+
+#endif // PhxOutbox_H
@@ -2,59 +2,104 @@
 #include "PhxChannel.h"
 #include "PhxSocket.h"
 #include <algorithm>
-#include <chrono>
-#include <future>
-#include <thread>
+
+namespace {
+
+/*!< The atom of a reply's status, None if it has none or it was never
+  passed to onReceive. */
+PhxAtom statusOf(const nlohmann::json& reply) {
+    if (!reply.is_object()) {
+        return PhxAtoms::None;
+    }
+
+    auto status = reply.find("status");
+    if (status == reply.end() || !status->is_string()) {
+        return PhxAtoms::None;
+    }
+
+    return PhxAtoms::lookup(status->get_ref<const std::string&>());
+}
+
+} // namespace
 
 PhxPush::PhxPush(std::shared_ptr<PhxChannel> channel,
     const std::string& event,
     nlohmann::json payload) {
     this->channel = channel;
     this->event = event;
-    this->payload = payload;
+    this->payload = std::move(payload);
 
     this->receivedResp = nullptr;
     this->afterHook = nullptr;
+    this->afterInterval = 0;
+    this->afterTimer = 0;
+    this->ref = -1;
     this->sent = false;
 }
 
+PhxPush::PhxPush(std::shared_ptr<PhxChannel> channel,
+    const std::string& event,
+    std::shared_ptr<const std::string> rawPayload)
+    : PhxPush(channel, event, nlohmann::json()) {
+    this->rawPayload = std::move(rawPayload);
+}
+
+PhxPush::~PhxPush() {
+    this->cancelAfter();
+}
+
 void PhxPush::send() {
-    int64_t ref = this->channel->getSocket()->makeRef();
-    this->refEvent = this->channel->replyEventName(ref);
+    std::shared_ptr<PhxSocket> socket = this->channel->getSocket();
+    if (this->sent) {
+        this->cancelRefEvent();
+    }
+
+    this->ref = socket->makeRef();
     this->receivedResp = nullptr;
     this->sent = false;
 
-    // FIXME: Should this be weak?
-    this->channel->onEvent(
-        this->refEvent, [this](nlohmann::json message, int64_t ref) {
-            this->receivedResp = message;
-            this->matchReceive(message);
-            this->cancelRefEvent();
-            this->cancelAfter();
-        });
+    // The socket holds on to us until the reply comes back or times out, so
+    // a push nobody else keeps still sees its reply.
+    std::shared_ptr<PhxPush> self = this->shared_from_this();
+    socket->onReply(this->ref, [self](const Payload& message, int64_t ref) {
+        self->receivedResp = message;
+        self->matchReceive(*message);
+        self->cancelAfter();
+    });
 
+    this->cancelAfter();
     this->startAfter();
     this->sent = true;
 
-    // clang-format off
-    this->channel->getSocket()->push(
-        { { "topic", this->channel->getTopic() },
-          { "event", this->event },
-          { "payload", this->payload },
-          { "ref", ref }
-        });
-    // clang-format on
+    // A join is its own join_ref.
+    int64_t joinRef = this->event == "phx_join"
+        ? this->ref
+        : this->channel->getJoinRef();
+    if (this->rawPayload) {
+        socket->pushRaw(this->channel->getTopic(),
+            this->event,
+            *this->rawPayload,
+            this->ref,
+            joinRef);
+    } else {
+        socket->push(this->channel->getTopic(),
+            this->event,
+            this->payload,
+            this->ref,
+            joinRef);
+    }
 }
 
 std::shared_ptr<PhxPush> PhxPush::onReceive(
     const std::string& status, OnMessage callback) {
+    PhxAtom atom = PhxAtoms::intern(status);
+
     // receivedResp could actually be a std::string.
-    if (this->receivedResp.is_object()
-        && this->receivedResp["status"] == status) {
-        callback(this->receivedResp);
+    if (this->receivedResp && statusOf(*this->receivedResp) == atom) {
+        callback(*this->receivedResp);
     }
 
-    this->recHooks.emplace_back(status, callback);
+    this->recHooks.emplace_back(atom, callback);
     return this->shared_from_this();
 }
 
@@ -65,24 +110,28 @@ std::shared_ptr<PhxPush> PhxPush::after(int ms, After callback) {
 
     this->afterInterval = ms;
     this->afterHook = callback;
+
+    // pushEvent sends straight away, so the timer may need starting here.
+    if (this->sent && !this->afterTimer && !this->receivedResp) {
+        this->startAfter();
+    }
+
     return this->shared_from_this();
 }
 
+int64_t PhxPush::getRef() {
+    return this->ref;
+}
+
 void PhxPush::cancelRefEvent() {
-    this->channel->offEvent(this->refEvent);
+    this->channel->getSocket()->offReply(this->ref);
 }
 
 void PhxPush::cancelAfter() {
-    if (!this->afterHook) {
-        return;
+    if (this->afterTimer) {
+        this->channel->getSocket()->cancelTimeout(this->afterTimer);
+        this->afterTimer = 0;
     }
-
-    std::thread thread([this]() {
-        std::lock_guard<std::mutex> guard(this->afterTimerMutex);
-        this->shouldContinueAfterCallback = false;
-    });
-
-    thread.detach();
 }
 
 void PhxPush::startAfter() {
@@ -90,32 +139,40 @@ void PhxPush::startAfter() {
         return;
     }
 
-    // FIXME: Should this be weak?
-    int interval = this->afterInterval;
-    std::thread thread([this, interval]() {
-        // Use sleep_for to wait specified time (or sleep_until).
-        this->shouldContinueAfterCallback = true;
-        std::this_thread::sleep_for(std::chrono::seconds{ interval });
-        std::lock_guard<std::mutex> guard(this->afterTimerMutex);
-        if (this->shouldContinueAfterCallback) {
-            this->cancelRefEvent();
-            this->afterHook();
-            this->shouldContinueAfterCallback = false;
-        }
-    });
-
-    thread.detach();
+    std::weak_ptr<PhxPush> weak = this->shared_from_this();
+    this->afterTimer = this->channel->getSocket()->setTimeout(
+        this->afterInterval, [weak]() {
+            // Runs on the socket's thread, same as the reply handler.
+            std::shared_ptr<PhxPush> push = weak.lock();
+            if (push && push->afterTimer) {
+                push->afterTimer = 0;
+                push->cancelRefEvent();
+                push->afterHook();
+            }
+        });
 }
 
-void PhxPush::matchReceive(nlohmann::json payload) {
-    for (int i = 0; i < this->recHooks.size(); i++) {
-        std::tuple<std::string, OnMessage> tuple = this->recHooks.at(i);
-        if (std::get<0>(tuple) == payload["status"]) {
-            std::get<1>(tuple)(payload["response"]);
+void PhxPush::matchReceive(const nlohmann::json& payload) {
+    PhxAtom status = statusOf(payload);
+    if (status == PhxAtoms::None) {
+        return;
+    }
+
+    // Hooks are handed views into payload; nothing here copies it.
+    static const nlohmann::json none;
+    auto response = payload.find("response");
+    const nlohmann::json& resp
+        = response != payload.end() ? *response : none;
+    for (size_t i = 0; i < this->recHooks.size(); i++) {
+        if (std::get<0>(this->recHooks[i]) == status) {
+            // A hook may add hooks, so don't call it in place.
+            OnMessage callback = std::get<1>(this->recHooks[i]);
+            callback(resp);
         }
     }
 }
 
 void PhxPush::setPayload(nlohmann::json payload) {
-    this->payload = payload;
+    this->payload = std::move(payload);
+    this->rawPayload = nullptr;
 }
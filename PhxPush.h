@@ -9,10 +9,11 @@
 
 #ifndef PhxPush_H
 #define PhxPush_H
+#include "PhxAtom.h"
 #include "PhxTypes.h"
+#include "TimerWheel.h"
 #include <map>
 #include <memory>
-#include <mutex>
 #include <string>
 #include <vector>
 
@@ -26,39 +27,43 @@ private:
     /*!< The event name the server listens on. */
     std::string event;
 
-    /*!< Name of event for the message. */
-    std::string refEvent;
+    /*!< Ref the message was last sent with, which its reply carries. */
+    int64_t ref;
 
     /*!< Holds the payload that will be sent to the server. */
     nlohmann::json payload;
 
+    /*!< Payload JSON text sent in place of payload when set. */
+    std::shared_ptr<const std::string> rawPayload;
+
     /*!< The callback to trigger if event is not returned from server. */
     After afterHook;
 
-    /*!< The interval to wait before triggering afterHook. */
+    /*!< The interval in milliseconds to wait before triggering afterHook. */
     int afterInterval;
 
     /*!<
-     * recHooks contains a list of tuples where Item 1 is the Status
-     * and Item 2 is the callback.
+     * recHooks contains a list of tuples where Item 1 is the interned
+     * Status and Item 2 is the callback.
      */
-    std::vector<std::tuple<std::string, OnMessage>> recHooks;
+    std::vector<std::tuple<PhxAtom, OnMessage>> recHooks;
 
-    /*!< The response from server if server responded to sent message. */
-    nlohmann::json receivedResp;
+    /*!< The reply from server if server responded to sent message, shared
+     * with the socket that parsed it. Null until then.
+     */
+    Payload receivedResp;
 
     /*!< Flag determining whether or not the message was sent through Sockets.
      */
     bool sent;
 
-    /*!< Mutex used when setting this->shouldContinueAfterCallback. */
-    std::mutex afterTimerMutex;
-
-    /*!< Flag that determines if After callback will be triggered. */
-    bool shouldContinueAfterCallback;
+    /*!< Pending timer for afterHook, 0 if none. Only touched on the socket's
+     * thread once sent.
+     */
+    TimerWheel::TimerId afterTimer;
 
     /**
-     *  \brief Stops listening for this event.
+     *  \brief Stops waiting on the reply to the last send.
      *
      *  \return void
      */
@@ -84,14 +89,14 @@ private:
      *  \param payload Payload to match against.
      *  \return void
      */
-    void matchReceive(nlohmann::json payload);
+    void matchReceive(const nlohmann::json& payload);
 
 public:
     /**
      *  \brief Sets the payload that this class will push out through
      * Websockets.
      *
-     *  \param payload
+     *  \param payload The payload, moved in.
      *  \return void
      */
     void setPayload(nlohmann::json payload);
@@ -108,6 +113,20 @@ public:
         const std::string& event,
         nlohmann::json payload);
 
+    /**
+     *  \brief Constructor for a payload that is already JSON text.
+     *
+     *  \param channel The Phoenix Channel to send to.
+     *  \param event The Phoenix Event to post to.
+     *  \param rawPayload The payload's JSON text, sent without being parsed.
+     *  \return PhxPush
+     */
+    PhxPush(std::shared_ptr<PhxChannel> channel,
+        const std::string& event,
+        std::shared_ptr<const std::string> rawPayload);
+
+    ~PhxPush();
+
     /**
      *  \brief Sends Phoenix Formatted message with payload through Websockets.
      *
@@ -140,6 +159,13 @@ public:
      *  \return std::shared_ptr<PhxPush>
      */
     std::shared_ptr<PhxPush> after(int ms, After callback);
+
+    /**
+     *  \brief The ref the message was last sent with.
+     *
+     *  \return int64_t -1 if not sent yet.
+     */
+    int64_t getRef();
 };
 
 #endif // PhxPush_H
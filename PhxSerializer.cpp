@@ -0,0 +1,203 @@
+#include "PhxSerializer.h"
+#include <ostream>
+#include <streambuf>
+
+namespace {
+
+/*!< Lets nlohmann::json write its text onto the end of a string, instead of
+  into the stringstream dump() builds and then copies out. */
+class AppendBuffer : public std::streambuf {
+private:
+    std::string& out;
+
+protected:
+    int_type overflow(int_type c) {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            this->out += traits_type::to_char_type(c);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) {
+        this->out.append(s, static_cast<size_t>(n));
+        return n;
+    }
+
+public:
+    AppendBuffer(std::string& out)
+        : out(out) {
+    }
+};
+
+void appendPayload(std::string& out, const nlohmann::json& payload) {
+    AppendBuffer buffer(out);
+    std::ostream stream(&buffer);
+    stream << payload;
+}
+
+void appendPayload(std::string& out, const std::string& payload) {
+    // Phoenix expects a payload, so an empty one goes out as {}.
+    if (payload.empty()) {
+        out += "{}";
+    } else {
+        out += payload;
+    }
+}
+
+void appendRef(std::string& out, int64_t ref) {
+    char digits[20];
+    size_t n = 0;
+    do {
+        digits[n++] = static_cast<char>('0' + ref % 10);
+        ref /= 10;
+    } while (ref > 0);
+
+    while (n > 0) {
+        out += digits[--n];
+    }
+}
+
+void appendQuoted(std::string& out, const std::string& value) {
+    static const char hex[] = "0123456789abcdef";
+
+    out += '"';
+    for (char c : value) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                out += "\\u00";
+                out += hex[(c >> 4) & 0xf];
+                out += hex[c & 0xf];
+            } else {
+                out += c;
+            }
+            break;
+        }
+    }
+    out += '"';
+}
+
+/**
+ *  \brief Writes an envelope around payload.
+ *
+ *  \param payloadSize Bytes to reserve for the payload, 0 if unknown.
+ *  \return std::string
+ */
+template <typename Payload>
+std::string encodeWith(SerializerVersion version,
+    int64_t joinRef,
+    int64_t ref,
+    const std::string& topic,
+    const std::string& event,
+    const Payload& payload,
+    size_t payloadSize) {
+    // Everything, payload included, is written into this one string, which
+    // the WebSocket then takes ownership of.
+    std::string out;
+    out.reserve(topic.size() + event.size() + payloadSize + ENCODE_RESERVE);
+
+    if (version == SerializerVersion::V2) {
+        // Refs are strings in V2.
+        out += '[';
+        if (joinRef < 0) {
+            out += "null";
+        } else {
+            out += '"';
+            appendRef(out, joinRef);
+            out += '"';
+        }
+        out += ',';
+        if (ref < 0) {
+            out += "null";
+        } else {
+            out += '"';
+            appendRef(out, ref);
+            out += '"';
+        }
+        out += ',';
+        appendQuoted(out, topic);
+        out += ',';
+        appendQuoted(out, event);
+        out += ',';
+        appendPayload(out, payload);
+        out += ']';
+        return out;
+    }
+
+    out += "{\"topic\":";
+    appendQuoted(out, topic);
+    out += ",\"event\":";
+    appendQuoted(out, event);
+    out += ",\"payload\":";
+    appendPayload(out, payload);
+    out += ",\"ref\":";
+    if (ref < 0) {
+        out += "null";
+    } else {
+        appendRef(out, ref);
+    }
+    out += '}';
+    return out;
+}
+
+} // namespace
+
+PhxSerializer::PhxSerializer(SerializerVersion version) {
+    this->version = version;
+}
+
+SerializerVersion PhxSerializer::getVersion() {
+    return this->version;
+}
+
+void PhxSerializer::setVersion(SerializerVersion version) {
+    this->version = version;
+}
+
+const char* PhxSerializer::getVsn() {
+    return this->version == SerializerVersion::V2 ? "2.0.0" : "1.0.0";
+}
+
+std::string PhxSerializer::encode(int64_t joinRef,
+    int64_t ref,
+    const std::string& topic,
+    const std::string& event,
+    const nlohmann::json& payload) {
+    return encodeWith(this->version, joinRef, ref, topic, event, payload, 0);
+}
+
+std::string PhxSerializer::encodeRaw(int64_t joinRef,
+    int64_t ref,
+    const std::string& topic,
+    const std::string& event,
+    const std::string& payload) {
+    return encodeWith(
+        this->version, joinRef, ref, topic, event, payload, payload.size());
+}
+
+std::string PhxSerializer::encodeHeartbeat(int64_t ref) {
+    // Only the ref changes from one heartbeat to the next.
+    static const char v1Prefix[]
+        = "{\"topic\":\"phoenix\",\"event\":\"heartbeat\",\"payload\":{},"
+          "\"ref\":";
+    static const char v1Suffix[] = "}";
+    static const char v2Prefix[] = "[null,\"";
+    static const char v2Suffix[] = "\",\"phoenix\",\"heartbeat\",{}]";
+
+    const bool v2 = this->version == SerializerVersion::V2;
+    std::string out;
+    out.reserve(sizeof(v1Prefix) + sizeof(v1Suffix) + 20);
+    out.append(v2 ? v2Prefix : v1Prefix,
+        v2 ? sizeof(v2Prefix) - 1 : sizeof(v1Prefix) - 1);
+    appendRef(out, ref);
+    out.append(v2 ? v2Suffix : v1Suffix,
+        v2 ? sizeof(v2Suffix) - 1 : sizeof(v1Suffix) - 1);
+    return out;
+}
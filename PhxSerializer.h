@@ -0,0 +1,108 @@
+/**
+ *   \file PhxSerializer.h
+ *   \brief Encodes messages in the envelope format the server expects.
+ *
+ *  V1 (vsn=1.0.0) sends a {"topic","event","payload","ref"} object. V2
+ *  (vsn=2.0.0, the default since Phoenix 1.3) sends a
+ *  [join_ref, ref, topic, event, payload] array, which is smaller and
+ *  carries the join_ref needed to tell a rejoined channel's replies from
+ *  stale ones. The server picks its format from the vsn param in the
+ *  connect URL. PhxEnvelope::scan reads either.
+ *
+ *  Both are written straight into the string that gets sent: the payload is
+ *  streamed in place rather than dumped to a string of its own first.
+ */
+#ifndef PhxSerializer_H
+#define PhxSerializer_H
+
+#include "PhxTypes.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/*!< Bytes reserved past topic and event for the rest of an envelope, so a
+  small payload is written without the string growing. */
+#define ENCODE_RESERVE 128
+
+class PhxSerializer {
+private:
+    /*!< The envelope format to write. Atomic, since it may be changed while
+      other threads encode; each call reads it once. */
+    std::atomic<SerializerVersion> version;
+
+public:
+    /**
+     *  \brief Constructor
+     *
+     *  \param version The envelope format to write.
+     *  \return PhxSerializer
+     */
+    PhxSerializer(SerializerVersion version = SerializerVersion::V1);
+
+    /**
+     *  \brief The envelope format this serializer writes.
+     *
+     *  \return SerializerVersion
+     */
+    SerializerVersion getVersion();
+
+    /**
+     *  \brief Changes the envelope format. Safe while others encode.
+     *
+     *  \param version The envelope format to write.
+     *  \return void
+     */
+    void setVersion(SerializerVersion version);
+
+    /**
+     *  \brief The vsn param announcing this format in the connect URL.
+     *
+     *  \return const char*
+     */
+    const char* getVsn();
+
+    /**
+     *  \brief Serializes a message.
+     *
+     *  \param joinRef Ref of the channel's join, -1 for none. V1 drops it.
+     *  \param ref Ref of the message, -1 for none.
+     *  \param topic The topic.
+     *  \param event The event.
+     *  \param payload The payload.
+     *  \return std::string
+     */
+    std::string encode(int64_t joinRef,
+        int64_t ref,
+        const std::string& topic,
+        const std::string& event,
+        const nlohmann::json& payload);
+
+    /**
+     *  \brief Serializes a message whose payload is already JSON text.
+     *
+     *  The payload is copied into the envelope as is, without being parsed
+     *  or validated. An empty payload is sent as {}.
+     *
+     *  \param joinRef Ref of the channel's join, -1 for none. V1 drops it.
+     *  \param ref Ref of the message, -1 for none.
+     *  \param topic The topic.
+     *  \param event The event.
+     *  \param payload The payload's JSON text.
+     *  \return std::string
+     */
+    std::string encodeRaw(int64_t joinRef,
+        int64_t ref,
+        const std::string& topic,
+        const std::string& event,
+        const std::string& payload);
+
+    /**
+     *  \brief Serializes a heartbeat from a constant template.
+     *
+     *  \param ref Ref of the heartbeat.
+     *  \return std::string
+     */
+    std::string encodeHeartbeat(int64_t ref);
+};
+
+#endif // PhxSerializer_H
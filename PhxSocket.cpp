@@ -1,21 +1,78 @@
 #include "PhxSocket.h"
 #include "EasySocket.h"
 #include "PhxChannel.h"
-#include "ThreadPool.h"
+#include "PhxEnvelope.h"
+#include "TokenBucket.h"
+#include "easylogging++.h"
 #include <algorithm>
-#include <chrono>
-#include <future>
+#include <cctype>
 #include <map>
+#include <stdexcept>
 #include <string>
-#include <thread>
 
-#define POOL_SIZE 1
+namespace {
+
+/*!< Admits reconnects for every PhxSocket in the process. */
+TokenBucket& reconnectLimit() {
+    static TokenBucket bucket;
+    return bucket;
+}
+
+/*!< Picks where in its period a socket's heartbeat fires. Successive calls
+  step by the golden ratio, which spreads any number of sockets evenly
+  around the period, so a process's heartbeats don't all land on the same
+  tick. */
+int64_t heartBeatPhase(int64_t periodMs) {
+    static std::atomic<uint32_t> sockets(0);
+    double step = sockets++ * 0.6180339887498949;
+    double fraction = step - static_cast<uint64_t>(step);
+    return 1 + static_cast<int64_t>(fraction * (periodMs - 1));
+}
+
+/*!< Parses an envelope's payload into payload, unless it already holds it.
+  scan() skips over the payload without validating it, so a well-formed
+  envelope can still carry one that doesn't parse; that is logged and
+  false returned. json.hpp 2.1 throws std::invalid_argument or
+  std::out_of_range on bad input, hence std::logic_error. */
+bool parsePayload(const PhxEnvelope& envelope, Payload& payload) {
+    if (payload) {
+        return true;
+    }
+
+    try {
+        payload = std::make_shared<const nlohmann::json>(envelope.getPayload());
+    } catch (const std::logic_error& e) {
+        LOG(ERROR) << "Dropping message with malformed payload: " << e.what();
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace
 
 PhxSocket::PhxSocket(const std::string& url, int interval)
-    : pool(POOL_SIZE) {
+    : executor(Reactor::running())
+    , backoff(RECONNECT_BASE_MS, RECONNECT_MAX_MS) {
     this->url = url;
     this->heartBeatInterval = interval;
+    this->batchWindow = 0;
+    this->pingInterval = 0;
     this->reconnectOnError = true;
+    this->stableMs = RECONNECT_STABLE_MS;
+    this->opened = false;
+    this->ref = 0;
+    this->heartBeatTimer = 0;
+    this->heartBeatRef = -1;
+    this->heartBeatsMissed = 0;
+    this->heartBeatMissLimit = 1;
+    this->heartBeatRtt = -1;
+    this->adaptiveHeartBeat = true;
+    this->messagesSent = 0;
+    this->messagesReceived = 0;
+    this->sentAtLastBeat = 0;
+    this->receivedAtLastBeat = 0;
+    this->reconnectTimer = 0;
 }
 
 PhxSocket::PhxSocket(const std::string& url)
@@ -24,39 +81,78 @@ PhxSocket::PhxSocket(const std::string& url)
 
 PhxSocket::PhxSocket(
     const std::string& url, int interval, std::shared_ptr<WebSocket> socket)
-    : pool(POOL_SIZE) {
+    : executor(Reactor::running())
+    , backoff(RECONNECT_BASE_MS, RECONNECT_MAX_MS) {
     this->url = url;
     this->heartBeatInterval = interval;
+    this->batchWindow = 0;
+    this->pingInterval = 0;
     this->reconnectOnError = true;
+    this->stableMs = RECONNECT_STABLE_MS;
+    this->opened = false;
+    this->ref = 0;
+    this->heartBeatTimer = 0;
+    this->heartBeatRef = -1;
+    this->heartBeatsMissed = 0;
+    this->heartBeatMissLimit = 1;
+    this->heartBeatRtt = -1;
+    this->adaptiveHeartBeat = true;
+    this->messagesSent = 0;
+    this->messagesReceived = 0;
+    this->sentAtLastBeat = 0;
+    this->receivedAtLastBeat = 0;
+    this->reconnectTimer = 0;
     this->socket = std::move(socket);
 }
 
+PhxSocket::~PhxSocket() {
+    // Waits out a firing callback so it can't post to a dead executor.
+    TimerWheel::shared().cancel(this->heartBeatTimer);
+    TimerWheel::shared().cancel(this->reconnectTimer);
+}
+
 void PhxSocket::connect() {
     this->connect(std::map<std::string, std::string>());
 }
 
 void PhxSocket::connect(std::map<std::string, std::string> params) {
-    std::string url;
     this->params = params;
 
-    // FIXME: Add the parameters to the url.
-    if (this->params.size() > 0) {
-        url = this->url;
+    // The vsn param tells the server which serializer to speak. One given
+    // explicitly, in params or in the URL, picks ours; otherwise we announce
+    // ours.
+    std::string inUrl;
+    if (params.count("vsn") > 0) {
+        this->serializer.setVersion(versionFromVsn(params["vsn"]));
+    } else if (queryParam(this->url, "vsn", inUrl)) {
+        this->serializer.setVersion(versionFromVsn(inUrl));
     } else {
-        url = this->url;
+        params["vsn"] = this->serializer.getVsn();
+    }
+
+    std::string url = this->url;
+    char separator = url.find('?') == std::string::npos ? '?' : '&';
+    for (const std::pair<const std::string, std::string>& param : params) {
+        url += separator;
+        url += encodeParam(param.first);
+        url += '=';
+        url += encodeParam(param.second);
+        separator = '&';
     }
 
-    this->setCanReconnect(false);
+    this->discardReconnectTimer();
 
     // The socket hasn't been instantiated with a custom WebSocket.
-    if (!this->socket) {
-        std::shared_ptr<EasySocket> socket
-            = std::make_shared<EasySocket>(url, this);
-        this->socket = std::dynamic_pointer_cast<WebSocket, EasySocket>(socket);
+    std::shared_ptr<WebSocket> sk = std::atomic_load(&this->socket);
+    if (!sk) {
+        sk = std::make_shared<EasySocket>(url, this);
+        std::atomic_store(&this->socket, sk);
     }
 
-    this->socket->setURL(url);
-    this->socket->open();
+    sk->setURL(url);
+    sk->setBatchWindow(this->batchWindow);
+    sk->setPingInterval(this->pingInterval);
+    sk->open();
 }
 
 void PhxSocket::disconnect() {
@@ -70,6 +166,18 @@ void PhxSocket::reconnect() {
     this->connect(this->params);
 }
 
+void PhxSocket::setReconnectBackoff(
+    int64_t baseMs, int64_t maxMs, int64_t stableMs) {
+    this->executor.post([this, baseMs, maxMs, stableMs]() {
+        this->backoff.configure(baseMs, maxMs);
+        this->stableMs = stableMs;
+    });
+}
+
+void PhxSocket::setReconnectLimit(double perSecond, int burst) {
+    reconnectLimit().configure(perSecond, burst);
+}
+
 void PhxSocket::onOpen(OnOpen callback) {
     this->openCallbacks.push_back(callback);
 }
@@ -91,14 +199,91 @@ bool PhxSocket::isConnected() {
 }
 
 void PhxSocket::sendHeartbeat() {
-    // clang-format off
-    this->push({
-            { "topic", "phoenix" },
-            { "event", "heartbeat" },
-            { "payload", {} },
-            { "ref", this->makeRef() }
-        });
-    // clang-format on
+    std::shared_ptr<WebSocket> sk = std::atomic_load(&this->socket);
+    if (!sk) {
+        return;
+    }
+
+    // Traffic both ways since the last tick already proves what a heartbeat
+    // would, including that the server is still answering.
+    uint64_t sent = this->messagesSent;
+    bool busy = sent != this->sentAtLastBeat
+        && this->messagesReceived != this->receivedAtLastBeat;
+    this->sentAtLastBeat = sent;
+    this->receivedAtLastBeat = this->messagesReceived;
+    if (busy && this->adaptiveHeartBeat) {
+        this->heartBeatRef = -1;
+        this->heartBeatsMissed = 0;
+        return;
+    }
+
+    int limit = this->heartBeatMissLimit;
+    if (this->heartBeatRef != -1 && limit > 0
+        && ++this->heartBeatsMissed >= limit) {
+        // A half-open connection looks fine from here, so don't wait on the
+        // transport to notice: close it and let onConnClose reconnect. It is
+        // kept until the reconnect replaces it, so pushes made meanwhile
+        // reach a closed socket, which drops them, rather than a null one.
+        LOG(WARNING) << this->heartBeatsMissed
+                     << " heartbeats unanswered, reconnecting";
+        TimerWheel::shared().cancel(this->heartBeatTimer);
+        this->heartBeatTimer = 0;
+        sk->setDelegate(nullptr);
+        sk->close();
+        this->onConnClose("heartbeat timeout");
+        return;
+    }
+
+    this->heartBeatRef = this->makeRef();
+    this->heartBeatSentAt = std::chrono::steady_clock::now();
+    sk->send(this->serializer.encodeHeartbeat(this->heartBeatRef));
+}
+
+void PhxSocket::onHeartbeatReply(int64_t ref) {
+    if (ref != this->heartBeatRef) {
+        return;
+    }
+
+    int64_t rtt = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - this->heartBeatSentAt)
+                      .count();
+    this->heartBeatRtt = rtt;
+    {
+        std::lock_guard<std::mutex> guard(this->heartBeatRttsMutex);
+        this->heartBeatRtts.record(rtt);
+    }
+    this->heartBeatRef = -1;
+    this->heartBeatsMissed = 0;
+}
+
+void PhxSocket::setAdaptiveHeartbeat(bool adaptive) {
+    this->adaptiveHeartBeat = adaptive;
+}
+
+void PhxSocket::setHeartbeatMissLimit(int limit) {
+    this->heartBeatMissLimit = limit;
+}
+
+int64_t PhxSocket::getHeartbeatRtt() {
+    return this->heartBeatRtt;
+}
+
+LatencyHistogram PhxSocket::getHeartbeatRttHistogram() {
+    std::lock_guard<std::mutex> guard(this->heartBeatRttsMutex);
+    return this->heartBeatRtts;
+}
+
+void PhxSocket::setPingInterval(int ms) {
+    this->pingInterval = ms;
+    std::shared_ptr<WebSocket> sk = std::atomic_load(&this->socket);
+    if (sk) {
+        sk->setPingInterval(ms);
+    }
+}
+
+LatencyHistogram PhxSocket::getPingRtt() {
+    std::shared_ptr<WebSocket> sk = std::atomic_load(&this->socket);
+    return sk ? sk->getPingRtt() : LatencyHistogram();
 }
 
 int64_t PhxSocket::makeRef() {
@@ -106,7 +291,7 @@ int64_t PhxSocket::makeRef() {
 }
 
 SocketState PhxSocket::socketState() {
-    std::shared_ptr<WebSocket> sk = this->socket;
+    std::shared_ptr<WebSocket> sk = std::atomic_load(&this->socket);
     if (!sk) {
         return SocketClosed;
     }
@@ -115,48 +300,300 @@ SocketState PhxSocket::socketState() {
 }
 
 void PhxSocket::push(nlohmann::json data) {
-    this->socket->send(data.dump());
+    // Dropped after disconnect(); the push times out like any unanswered
+    // one.
+    std::shared_ptr<WebSocket> sk = std::atomic_load(&this->socket);
+    if (!sk) {
+        return;
+    }
+
+    this->messagesSent.fetch_add(1, std::memory_order_relaxed);
+    sk->send(data.dump());
+}
+
+void PhxSocket::push(const std::string& topic,
+    const std::string& event,
+    const nlohmann::json& payload,
+    int64_t ref,
+    int64_t joinRef) {
+    if (this->shouldHold(topic, event)) {
+        this->hold(topic, event, payload.dump(), ref);
+        return;
+    }
+
+    std::shared_ptr<WebSocket> sk = std::atomic_load(&this->socket);
+    if (!sk) {
+        return;
+    }
+
+    this->messagesSent.fetch_add(1, std::memory_order_relaxed);
+    sk->send(this->serializer.encode(joinRef, ref, topic, event, payload));
+}
+
+void PhxSocket::pushRaw(const std::string& topic,
+    const std::string& event,
+    const std::string& payload,
+    int64_t ref,
+    int64_t joinRef) {
+    if (this->shouldHold(topic, event)) {
+        this->hold(topic, event, std::string(payload), ref);
+        return;
+    }
+
+    std::shared_ptr<WebSocket> sk = std::atomic_load(&this->socket);
+    if (!sk) {
+        return;
+    }
+
+    this->messagesSent.fetch_add(1, std::memory_order_relaxed);
+    sk->send(this->serializer.encodeRaw(joinRef, ref, topic, event, payload));
+}
+
+void PhxSocket::setSerializerVersion(SerializerVersion version) {
+    this->serializer.setVersion(version);
+}
+
+void PhxSocket::setBatchWindow(int64_t us) {
+    this->batchWindow = us;
+    std::shared_ptr<WebSocket> sk = std::atomic_load(&this->socket);
+    if (sk) {
+        sk->setBatchWindow(us);
+    }
+}
+
+void PhxSocket::flush() {
+    std::shared_ptr<WebSocket> sk = std::atomic_load(&this->socket);
+    if (sk) {
+        sk->flush();
+    }
+}
+
+SendStats PhxSocket::getSendStats() {
+    std::shared_ptr<WebSocket> sk = std::atomic_load(&this->socket);
+    return sk ? sk->getSendStats() : SendStats();
+}
+
+void PhxSocket::setOutbox(size_t capacity, int ttlMs, OutboxPolicy policy) {
+    this->outbox.configure(capacity, ttlMs, policy);
+}
+
+void PhxSocket::holdOutbox(const std::string& topic) {
+    this->outbox.block(topic);
+}
+
+void PhxSocket::replayOutbox(const std::string& topic, int64_t joinRef) {
+    std::shared_ptr<WebSocket> sk = std::atomic_load(&this->socket);
+    if (!sk) {
+        return;
+    }
+
+    std::vector<int64_t> expired;
+    this->outbox.replay(topic,
+        [this, &sk, joinRef](const PhxOutbox::Message& message) {
+            this->messagesSent.fetch_add(1, std::memory_order_relaxed);
+            sk->send(this->serializer.encodeRaw(joinRef,
+                message.ref,
+                message.topic,
+                message.event,
+                message.payload));
+        },
+        expired);
+
+    for (int64_t ref : expired) {
+        this->offReply(ref);
+    }
+}
+
+size_t PhxSocket::getOutboxDepth() {
+    return this->outbox.size();
+}
+
+uint64_t PhxSocket::getOutboxDropped() {
+    return this->outbox.getDropped();
+}
+
+void PhxSocket::onReply(int64_t ref, OnReply callback) {
+    std::lock_guard<std::mutex> guard(this->pendingRepliesMutex);
+    this->pendingReplies[ref] = std::move(callback);
+}
+
+void PhxSocket::offReply(int64_t ref) {
+    OnReply callback;
+    {
+        std::lock_guard<std::mutex> guard(this->pendingRepliesMutex);
+        auto it = this->pendingReplies.find(ref);
+        if (it == this->pendingReplies.end()) {
+            return;
+        }
+
+        // Destroyed outside the lock; it may own the last ref to a push.
+        callback = std::move(it->second);
+        this->pendingReplies.erase(it);
+    }
+}
+
+TimerWheel::TimerId PhxSocket::setTimeout(int ms, After callback) {
+    return TimerWheel::shared().schedule(
+        ms, [this, callback]() { this->executor.post(callback); });
+}
+
+void PhxSocket::cancelTimeout(TimerWheel::TimerId id) {
+    TimerWheel::shared().cancel(id);
 }
 
 // Private
 
+SerializerVersion PhxSocket::versionFromVsn(const std::string& vsn) {
+    return vsn.compare(0, 2, "2.") == 0 ? SerializerVersion::V2
+                                        : SerializerVersion::V1;
+}
+
+bool PhxSocket::queryParam(
+    const std::string& url, const std::string& key, std::string& value) {
+    // The query runs from the first '?' to the fragment, if any.
+    size_t end = url.find('#');
+    if (end == std::string::npos) {
+        end = url.size();
+    }
+
+    size_t query = url.find('?');
+    if (query >= end) {
+        return false;
+    }
+
+    for (size_t start = query + 1; start < end;) {
+        size_t next = url.find('&', start);
+        if (next == std::string::npos || next > end) {
+            next = end;
+        }
+
+        size_t equals = url.find('=', start);
+        size_t keyEnd = equals < next ? equals : next;
+        if (url.compare(start, keyEnd - start, key) == 0) {
+            value = keyEnd < next ? url.substr(keyEnd + 1, next - keyEnd - 1)
+                                  : std::string();
+            return true;
+        }
+
+        start = next + 1;
+    }
+
+    return false;
+}
+
+std::string PhxSocket::encodeParam(const std::string& value) {
+    static const char hex[] = "0123456789ABCDEF";
+
+    std::string out;
+    for (char c : value) {
+        if (isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_'
+            || c == '.' || c == '~') {
+            out += c;
+        } else {
+            out += '%';
+            out += hex[(static_cast<unsigned char>(c) >> 4) & 0xf];
+            out += hex[c & 0xf];
+        }
+    }
+
+    return out;
+}
+
+bool PhxSocket::shouldHold(const std::string& topic, const std::string& event) {
+    if (!this->outbox.isEnabled()) {
+        return false;
+    }
+
+    // The channel redoes its own joins and leaves.
+    if (event.compare(0, 4, "phx_") == 0) {
+        return false;
+    }
+
+    // Queue behind anything held for the topic, so pushes stay in order.
+    return !this->isConnected() || this->outbox.holds(topic);
+}
+
+void PhxSocket::hold(const std::string& topic,
+    const std::string& event,
+    std::string&& payload,
+    int64_t ref) {
+    std::vector<int64_t> dropped;
+    this->outbox.push(topic, event, std::move(payload), ref, dropped);
+
+    // Their replies will never come.
+    for (int64_t ref : dropped) {
+        this->offReply(ref);
+    }
+}
+
 void PhxSocket::discardHeartBeatTimer() {
-    this->setCanSendHeartBeat(false);
+    this->executor.post([this]() {
+        TimerWheel::shared().cancel(this->heartBeatTimer);
+        this->heartBeatTimer = 0;
+    });
 }
 
 void PhxSocket::discardReconnectTimer() {
-    this->setCanReconnect(false);
+    this->executor.post([this]() {
+        TimerWheel::shared().cancel(this->reconnectTimer);
+        this->reconnectTimer = 0;
+    });
+}
+
+void PhxSocket::scheduleReconnect() {
+    this->armReconnectTimer(
+        this->backoff.next(), [this]() { this->admitReconnect(); });
+}
+
+void PhxSocket::admitReconnect() {
+    // The token is ours either way; a wait means others got there first.
+    int64_t wait = reconnectLimit().reserve();
+    if (wait > 0) {
+        this->armReconnectTimer(wait, [this]() { this->reconnect(); });
+    } else {
+        this->reconnect();
+    }
+}
+
+void PhxSocket::armReconnectTimer(int64_t ms, After callback) {
+    this->reconnectTimer = this->setTimeout(ms, [this, callback]() {
+        // Zeroed if the timer was discarded after it fired.
+        if (this->reconnectTimer) {
+            this->reconnectTimer = 0;
+            callback();
+        }
+    });
 }
 
 void PhxSocket::disconnectSocket() {
-    if (this->socket) {
-        this->socket->setDelegate(nullptr);
-        this->socket->close();
-        this->socket = nullptr;
+    // Taken out first, so nothing else picks it up while it closes.
+    std::shared_ptr<WebSocket> sk
+        = std::atomic_exchange(&this->socket, std::shared_ptr<WebSocket>());
+    if (sk) {
+        sk->setDelegate(nullptr);
+        sk->close();
     }
 }
 
 void PhxSocket::onConnOpen() {
     this->discardReconnectTimer();
+    this->openedAt = std::chrono::steady_clock::now();
+    this->opened = true;
+    this->heartBeatRef = -1;
+    this->heartBeatsMissed = 0;
 
     // After the socket connection is opened, continue to send heartbeats
-    // to keep the connection alive.
+    // to keep the connection alive. Every socket's heartbeats run off the
+    // shared wheel, each at its own phase of the period.
     if (this->heartBeatInterval > 0) {
-        std::thread thread([this]() {
-            this->setCanSendHeartBeat(true);
-            while (true) {
-                std::this_thread::sleep_for(
-                    std::chrono::seconds{ this->heartBeatInterval });
-
-                if (this->canSendHeartbeat) {
-                    this->pool.enqueue([this]() { this->sendHeartbeat(); });
-                } else {
-                    break;
-                }
-            }
-        });
-
-        thread.detach();
+        int ms = this->heartBeatInterval * 1000;
+        TimerWheel::shared().cancel(this->heartBeatTimer);
+        this->heartBeatTimer = TimerWheel::shared().schedule(
+            heartBeatPhase(ms),
+            [this]() {
+                this->executor.post([this]() { this->sendHeartbeat(); });
+            },
+            ms);
     }
 
     for (int i = 0; i < this->openCallbacks.size(); i++) {
@@ -172,32 +609,39 @@ void PhxSocket::onConnOpen() {
 void PhxSocket::onConnClose(const std::string& event) {
     this->triggerChanError(event);
 
-    // When connection is closed, attempt to reconnect.
-    if (this->reconnectOnError) {
-        if (!this->reconnecting) {
-            this->reconnecting = true;
-            this->canReconnect = true;
-
-            std::thread thread([this]() {
-                std::this_thread::sleep_for(
-                    std::chrono::seconds{ RECONNECT_INTERVAL });
-
-                this->pool.enqueue([this]() {
-                    if (this->canReconnect) {
-                        this->canReconnect = false;
-                        this->reconnect();
-                    }
-
-                    this->reconnecting = false;
-                });
-            });
-
-            thread.detach();
+    // Only a connection that held up earns a fresh backoff; one that drops
+    // straight after opening keeps backing off.
+    if (this->opened) {
+        this->opened = false;
+        if (std::chrono::steady_clock::now() - this->openedAt
+            >= std::chrono::milliseconds(this->stableMs)) {
+            this->backoff.reset();
         }
     }
 
+    // When connection is closed, attempt to reconnect.
+    if (this->reconnectOnError && !this->reconnectTimer) {
+        this->scheduleReconnect();
+    }
+
     this->discardHeartBeatTimer();
 
+    // Replies to anything sent over this connection will never arrive.
+    // Pushes still in the outbox haven't been sent yet, so keep theirs.
+    std::unordered_map<int64_t, OnReply> pending;
+    std::vector<int64_t> held = this->outbox.getRefs();
+    {
+        std::lock_guard<std::mutex> guard(this->pendingRepliesMutex);
+        pending.swap(this->pendingReplies);
+        for (int64_t ref : held) {
+            auto it = pending.find(ref);
+            if (it != pending.end()) {
+                this->pendingReplies.insert(std::move(*it));
+                pending.erase(it);
+            }
+        }
+    }
+
     for (int i = 0; i < this->closeCallbacks.size(); i++) {
         OnClose callback = this->closeCallbacks.at(i);
         callback(event);
@@ -224,84 +668,154 @@ void PhxSocket::onConnError(const std::string& error) {
 }
 
 void PhxSocket::onConnMessage(const std::string& rawMessage) {
-    nlohmann::json json = nlohmann::json::parse(rawMessage);
-    const std::string json_topic = json["topic"];
-    const std::string json_event = json["event"];
-    nlohmann::json json_ref = json["ref"];
-    nlohmann::json json_payload = json["payload"];
-
-    // Ref can be null, so check for it first.
-    int64_t ref = -1;
-    if (!json_ref.is_null()) {
-        ref = json_ref;
-    }
-
-    for (int i = 0; i < this->channels.size(); i++) {
-        std::shared_ptr<PhxChannel> channel = this->channels.at(i);
-        if (channel->getTopic() == json_topic) {
-            channel->triggerEvent(json_event, json_payload, ref);
+    this->messagesReceived++;
+
+    PhxEnvelope envelope;
+    if (!envelope.scan(rawMessage)) {
+        LOG(ERROR) << "Dropping malformed message: " << rawMessage;
+        return;
+    }
+
+    // Events nobody registered have no atom, and nothing to route to.
+    PhxAtom event = PhxAtoms::lookup(envelope.event);
+
+    // Only build the payload if something is going to look at it. It is
+    // then parsed once and every handler shares it, by reference or by
+    // holding on to the pointer; none of them gets a copy.
+    Payload payload;
+
+    if (envelope.ref != -1 && event == PhxAtoms::PhxReply
+        && PhxAtoms::lookup(envelope.topic) == PhxAtoms::Phoenix) {
+        this->onHeartbeatReply(envelope.ref);
+    }
+
+    if (envelope.ref != -1 && event == PhxAtoms::PhxReply) {
+        OnReply callback;
+        {
+            std::lock_guard<std::mutex> guard(this->pendingRepliesMutex);
+            auto it = this->pendingReplies.find(envelope.ref);
+            if (it != this->pendingReplies.end()) {
+                callback = std::move(it->second);
+                this->pendingReplies.erase(it);
+            }
+        }
+
+        if (callback) {
+            if (!parsePayload(envelope, payload)) {
+                return;
+            }
+
+            callback(payload, envelope.ref);
         }
     }
 
-    for (int i = 0; i < this->messageCallbacks.size(); i++) {
-        OnMessage callback = this->messageCallbacks.at(i);
-        callback(json);
+    // addChannel/removeChannel only post, so callbacks can't invalidate this.
+    auto it = event != PhxAtoms::None ? this->channels.find(envelope.topic)
+                                      : this->channels.end();
+    if (it != this->channels.end()) {
+        // Lifecycle messages for an earlier join of the channel are stale.
+        bool lifecycle
+            = envelope.joinRef != -1 && PhxAtoms::isLifecycle(event);
+        for (std::shared_ptr<PhxChannel>& channel : it->second) {
+            if (!channel->hasBinding(event)
+                || (lifecycle && envelope.joinRef != channel->getJoinRef())) {
+                continue;
+            }
+
+            if (!parsePayload(envelope, payload)) {
+                return;
+            }
+
+            channel->triggerEvent(event, *payload, envelope.ref);
+        }
+    }
+
+    if (!this->messageCallbacks.empty()) {
+        nlohmann::json json;
+        try {
+            json = nlohmann::json::parse(rawMessage);
+        } catch (const std::logic_error& e) {
+            LOG(ERROR) << "Dropping malformed message: " << e.what();
+            return;
+        }
+
+        // Callbacks get the V1 object whichever format came in, so they
+        // don't have to know which was negotiated. scan() has checked the
+        // array's shape.
+        if (json.is_array()) {
+            nlohmann::json message = nlohmann::json::object();
+            message["join_ref"] = std::move(json[0]);
+            message["ref"] = std::move(json[1]);
+            message["topic"] = std::move(json[2]);
+            message["event"] = std::move(json[3]);
+            message["payload"] = std::move(json[4]);
+            json = std::move(message);
+        }
+
+        for (int i = 0; i < this->messageCallbacks.size(); i++) {
+            OnMessage callback = this->messageCallbacks.at(i);
+            callback(json);
+        }
     }
 }
 
 void PhxSocket::triggerChanError(const std::string& error) {
-    for (int i = 0; i < this->channels.size(); i++) {
-        std::shared_ptr<PhxChannel> channel = this->channels.at(i);
-        channel->triggerEvent("phx_error", error, 0);
+    const nlohmann::json message = error;
+    for (auto& it : this->channels) {
+        for (std::shared_ptr<PhxChannel>& channel : it.second) {
+            channel->triggerEvent(PhxAtoms::PhxError, message, 0);
+        }
     }
 }
 
 void PhxSocket::addChannel(std::shared_ptr<PhxChannel> channel) {
-    this->channels.emplace_back(channel);
+    this->executor.post([this, channel]() {
+        std::vector<std::shared_ptr<PhxChannel>>& chans
+            = this->channels[channel->getTopic()];
+        if (std::find(chans.begin(), chans.end(), channel) == chans.end()) {
+            chans.push_back(channel);
+        }
+    });
 }
 
 void PhxSocket::removeChannel(std::shared_ptr<PhxChannel> channel) {
-    std::vector<std::shared_ptr<PhxChannel>> chans = this->channels;
-    std::vector<std::shared_ptr<PhxChannel>>::iterator position
-        = std::find(chans.begin(), chans.end(), channel);
-    if (position != chans.end()) {
-        chans.erase(position);
-    }
+    this->executor.post([this, channel]() {
+        auto it = this->channels.find(channel->getTopic());
+        if (it == this->channels.end()) {
+            return;
+        }
+
+        std::vector<std::shared_ptr<PhxChannel>>& chans = it->second;
+        chans.erase(
+            std::remove(chans.begin(), chans.end(), channel), chans.end());
+        if (chans.empty()) {
+            this->channels.erase(it);
+        }
+    });
 }
 
 void PhxSocket::setDelegate(std::shared_ptr<PhxSocketDelegate> delegate) {
     this->delegate = delegate;
 }
 
-void PhxSocket::setCanReconnect(bool canReconnect) {
-    this->pool.enqueue(
-        [this, canReconnect]() { this->canReconnect = canReconnect; });
-}
-
-void PhxSocket::setCanSendHeartBeat(bool canSendHeartbeat) {
-    this->pool.enqueue([this, canSendHeartbeat]() {
-        this->canSendHeartbeat = canSendHeartbeat;
-    });
-}
-
 // SocketDelegate
 
 void PhxSocket::webSocketDidOpen(WebSocket* socket) {
-    this->pool.enqueue([this]() { this->onConnOpen(); });
+    this->executor.post([this]() { this->onConnOpen(); });
 }
 
-void PhxSocket::webSocketDidReceive(
-    WebSocket* socket, const std::string& message) {
-    this->pool.enqueue([this, message]() { this->onConnMessage(message); });
+void PhxSocket::webSocketDidReceive(WebSocket* socket, std::string message) {
+    this->executor.post(
+        std::bind(&PhxSocket::onConnMessage, this, std::move(message)));
 }
 
 void PhxSocket::webSocketDidError(WebSocket* socket, const std::string& error) {
-    this->pool.enqueue([this, error]() { this->onConnError(error); });
+    this->executor.post([this, error]() { this->onConnError(error); });
 }
 
 void PhxSocket::webSocketDidClose(
     WebSocket* socket, int code, const std::string& reason, bool wasClean) {
-    this->pool.enqueue([this, reason]() { this->onConnClose(reason); });
+    this->executor.post([this, reason]() { this->onConnClose(reason); });
 }
 
 // SocketDelegate
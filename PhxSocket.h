@@ -8,13 +8,23 @@
 #ifndef PhxSocketDelegate_H
 #define PhxSocketDelegate_H
 
+#include "Backoff.h"
+#include "PhxAtom.h"
+#include "PhxOutbox.h"
+#include "PhxSerializer.h"
 #include "PhxTypes.h"
+#include "Reactor.h"
+#include "SerialExecutor.h"
 #include "SocketDelegate.h"
-#include "ThreadPool.h"
+#include "TimerWheel.h"
 #include "WebSocket.h"
+#include <atomic>
+#include <chrono>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 class PhxSocketDelegate {
@@ -33,12 +43,20 @@ class WebSocket;
 #ifndef PhxSocket_H
 #define PhxSocket_H
 
-#define RECONNECT_INTERVAL 5
+/*!< Reconnects wait a random delay in [0, base * 2^attempt], capped at
+  max. */
+#define RECONNECT_BASE_MS 1000
+#define RECONNECT_MAX_MS 30000
+
+/*!< A connection that stayed open this long resets the backoff. */
+#define RECONNECT_STABLE_MS 10000
 
 class PhxSocket : public SocketDelegate {
 private:
-    /*!< Single Thread Thread Pool used for synchronization. */
-    ThreadPool pool;
+    /*!< Runs every callback one at a time, used for synchronization. Has a
+      thread of its own unless the shared Reactor was running when this was
+      made, in which case it runs on the reactor's threads. */
+    SerialExecutor executor;
 
     /*! Delegate that can listen in on Phoenix related callbacks. */
     std::weak_ptr<PhxSocketDelegate> delegate;
@@ -46,21 +64,46 @@ private:
     /*!
      * The underlying WebSocket interface. This can be used with a
      * different library provided the WebSocket interface is implemented.
+     * Replaced on reconnect while other threads push, so only read or
+     * written through std::atomic_load and friends.
      */
     std::shared_ptr<WebSocket> socket;
 
     /*!< Flag indicating whether or not to reconnect when socket errors out. */
     bool reconnectOnError;
 
+    /*!< Draws reconnect delays. Only touched on executor. */
+    Backoff backoff;
+
+    /*!< How long a connection has to last to reset backoff. */
+    int64_t stableMs;
+
+    /*!< When the current connection opened. Only touched on executor. */
+    std::chrono::steady_clock::time_point openedAt;
+
+    /*!< Whether openedAt is for a connection that hasn't closed yet. */
+    bool opened;
+
     /*!< Websocket URL to connect to. */
     std::string url;
 
+    /*!< Encodes outgoing messages in the format negotiated by vsn. */
+    PhxSerializer serializer;
+
     /*!< The interval at which to send heartbeats to server. */
     int heartBeatInterval;
 
-    /*!< The list of channels interested in sending messages over this socket.
+    /*!< Batching window handed to the WebSocket on connect, microseconds. */
+    int64_t batchWindow;
+
+    /*!< PING interval handed to the WebSocket on connect, milliseconds. */
+    int pingInterval;
+
+    /*!< Channels interested in sending messages over this socket, indexed
+     * by topic. Only touched on executor.
      */
-    std::vector<std::shared_ptr<PhxChannel>> channels;
+    std::unordered_map<std::string, std::vector<std::shared_ptr<PhxChannel>>>
+        channels;
 
     /*!< List of callbacks when socket opens. */
     std::vector<OnOpen> openCallbacks;
@@ -78,7 +121,43 @@ private:
     std::map<std::string, std::string> params;
 
     /*!< Ref to keep track of for each WebSocket message. */
-    int ref = 0;
+    std::atomic<int64_t> ref;
+
+    /*!< Callbacks waiting on a phx_reply, keyed by the ref they were sent
+     * with.
+     */
+    std::unordered_map<int64_t, OnReply> pendingReplies;
+
+    /*!< Guards pendingReplies, which pushes register from any thread. */
+    std::mutex pendingRepliesMutex;
+
+    /*!< Pushes made while disconnected, waiting for their channel to
+     * rejoin. Off unless setOutbox is called.
+     */
+    PhxOutbox outbox;
+
+    /**
+     *  \brief Whether a push has to wait in the outbox instead of going out.
+     *
+     *  \param topic The topic.
+     *  \param event The event.
+     *  \return bool
+     */
+    bool shouldHold(const std::string& topic, const std::string& event);
+
+    /**
+     *  \brief Adds a push to the outbox, dropping replies to what it drops.
+     *
+     *  \param topic The topic.
+     *  \param event The event.
+     *  \param payload The payload's JSON text, moved in.
+     *  \param ref The ref of the message.
+     *  \return void
+     */
+    void hold(const std::string& topic,
+        const std::string& event,
+        std::string&& payload,
+        int64_t ref);
 
     /**
      *  \brief Stops the heartbeating.
@@ -87,8 +166,62 @@ private:
      */
     void discardHeartBeatTimer();
 
-    /*!< Flag indicating whether or not to continue sending heartbeats. */
-    bool canSendHeartbeat;
+    /*!< Periodic timer sending heartbeats, 0 if none. Only touched on
+     * executor.
+     */
+    TimerWheel::TimerId heartBeatTimer;
+
+    /*!< Ref of the heartbeat awaiting its reply, -1 if none. Only touched
+     * on executor.
+     */
+    int64_t heartBeatRef;
+
+    /*!< When the heartbeat awaiting its reply was sent. */
+    std::chrono::steady_clock::time_point heartBeatSentAt;
+
+    /*!< Heartbeats in a row that went unanswered. Only touched on executor.
+     */
+    int heartBeatsMissed;
+
+    /*!< Unanswered heartbeats after which the connection is presumed dead,
+     * 0 to never presume so.
+     */
+    std::atomic<int> heartBeatMissLimit;
+
+    /*!< Round trip time of the last answered heartbeat, microseconds. */
+    std::atomic<int64_t> heartBeatRtt;
+
+    /*!< Round trip times of every answered heartbeat. Guarded by
+     * heartBeatRttsMutex.
+     */
+    LatencyHistogram heartBeatRtts;
+
+    std::mutex heartBeatRttsMutex;
+
+    /*!< Whether heartbeats are skipped while traffic flows both ways. */
+    std::atomic<bool> adaptiveHeartBeat;
+
+    /*!< Messages pushed, counted to tell whether the server has heard from
+     * us since the last heartbeat.
+     */
+    std::atomic<uint64_t> messagesSent;
+
+    /*!< Messages received. Only touched on executor. */
+    uint64_t messagesReceived;
+
+    /*!< messagesSent and messagesReceived as of the last heartbeat tick.
+     * Only touched on executor.
+     */
+    uint64_t sentAtLastBeat;
+    uint64_t receivedAtLastBeat;
+
+    /**
+     *  \brief Handles the server's reply to a heartbeat.
+     *
+     *  \param ref The ref of the reply.
+     *  \return void
+     */
+    void onHeartbeatReply(int64_t ref);
 
     /**
      *  \brief Stops trying to reconnect the WebSocket.
@@ -97,12 +230,58 @@ private:
      */
     void discardReconnectTimer();
 
-    /*!< Flag indicating whether or not socket can reconnect to server. */
-    bool canReconnect;
+    /*!< Pending reconnect timer, 0 if none. Only touched on executor. */
+    TimerWheel::TimerId reconnectTimer;
 
-    /*!< Flag indicating whether or not we are in the process of reconnecting.
+    /**
+     *  \brief Schedules the next reconnect attempt after a backoff delay.
+     *
+     *  \return void
+     */
+    void scheduleReconnect();
+
+    /**
+     *  \brief Reconnects once the process-wide limit lets it.
+     *
+     *  \return void
      */
-    bool reconnecting;
+    void admitReconnect();
+
+    /**
+     *  \brief Arms reconnectTimer to run callback after ms.
+     *
+     *  \param ms Milliseconds to wait.
+     *  \param callback Run on executor unless the timer is discarded.
+     *  \return void
+     */
+    void armReconnectTimer(int64_t ms, After callback);
+
+    /**
+     *  \brief Picks the serializer for a vsn param, e.g. "2.0.0".
+     *
+     *  \param vsn The requested version.
+     *  \return SerializerVersion
+     */
+    static SerializerVersion versionFromVsn(const std::string& vsn);
+
+    /**
+     *  \brief Finds a parameter in a URL's query string by its exact key.
+     *
+     *  \param url The URL.
+     *  \param key The parameter's key, as it appears in the URL.
+     *  \param value Receives the parameter's value, as it appears.
+     *  \return bool False if the query has no such key.
+     */
+    static bool queryParam(
+        const std::string& url, const std::string& key, std::string& value);
+
+    /**
+     *  \brief Percent-encodes a URL query component.
+     *
+     *  \param value The text to encode.
+     *  \return std::string
+     */
+    static std::string encodeParam(const std::string& value);
 
     /**
      *  \brief Disconnects the socket.
@@ -153,34 +332,17 @@ private:
     /**
      *  \brief Sends a heartbeat to keep Websocket connection alive.
      *
-     *  \return void
-     */
-    void sendHeartbeat();
-
-    /**
-     *  \brief Sets this->canSendHeartbeat.
-     *
-     *  This is intended to be a semi-thread safe way to set this flag.
-     *
-     *  \param canSendHeartbeat Indicating whether or not this socket can
-     *  continue sending heartbeats.
-     *  \return void
-     */
-    void setCanSendHeartBeat(bool canSendHeartbeat);
-
-    /**
-     *  \brief Sets this->canReconnect.
-     *
-     *  This is intended to be a semi-thread safe way to set this flag.
+     *  If too many heartbeats have gone unanswered, the connection is
+     *  presumed dead instead: it is dropped and reconnected. If messages went
+     *  both ways since the last tick, the heartbeat is skipped.
      *
-     *  \param canReconnect Indicating whether or not the socket can reconnect.
      *  \return void
      */
-    void setCanReconnect(bool canReconnect);
+    void sendHeartbeat();
 
     // SocketDelegate
     void webSocketDidOpen(WebSocket* socket);
-    void webSocketDidReceive(WebSocket* socket, const std::string& message);
+    void webSocketDidReceive(WebSocket* socket, std::string message);
     void webSocketDidError(WebSocket* socket, const std::string& error);
     void webSocketDidClose(
         WebSocket* socket, int code, const std::string& reason, bool wasClean);
@@ -215,6 +377,8 @@ public:
         int interval,
         std::shared_ptr<WebSocket> socket);
 
+    ~PhxSocket();
+
     /**
      *  \brief Connects the Websocket.
      *
@@ -240,12 +404,106 @@ public:
     /**
      *  \brief Reconnects the socket after disconnection.
      *
-     *  The reconnection happens on a timer controlled by RECONNECT_INTERVAL.
+     *  This reconnects right away. Reconnects after a lost connection are
+     *  spaced out by the backoff set with setReconnectBackoff.
      *
      *  \return void
      */
     void reconnect();
 
+    /**
+     *  \brief Sets how long to wait between reconnect attempts.
+     *
+     *  Each wait is random, up to base doubled once per failed attempt and
+     *  capped at max, so many clients dropped at once don't all come back
+     *  together. A connection that stays open stableMs starts it over.
+     *
+     *  \param baseMs The longest first wait, in milliseconds.
+     *  \param maxMs The longest any wait gets, in milliseconds.
+     *  \param stableMs How long a connection has to last to reset the
+     *  backoff.
+     *  \return void
+     */
+    void setReconnectBackoff(
+        int64_t baseMs, int64_t maxMs, int64_t stableMs = RECONNECT_STABLE_MS);
+
+    /**
+     *  \brief Sets how many heartbeats may go unanswered in a row.
+     *
+     *  When the next heartbeat is due with that many unanswered, the
+     *  connection is presumed dead: it is dropped, as if the server had
+     *  closed it, and reconnected. With the default of 1, a connection that
+     *  silently stops carrying traffic is dropped within two heartbeat
+     *  intervals, instead of whenever TCP gives up on it.
+     *
+     *  \param limit Unanswered heartbeats tolerated, 0 to never drop.
+     *  \return void
+     */
+    void setHeartbeatMissLimit(int limit);
+
+    /**
+     *  \brief Whether to skip heartbeats while traffic flows both ways.
+     *
+     *  A message received since the last heartbeat shows the server is
+     *  alive, and one sent shows the server we are, so a heartbeat on a busy
+     *  connection proves nothing new. On by default. Skipped heartbeats
+     *  don't count as missed.
+     *
+     *  \param adaptive Whether to skip them.
+     *  \return void
+     */
+    void setAdaptiveHeartbeat(bool adaptive);
+
+    /**
+     *  \brief Round trip time of the last answered heartbeat.
+     *
+     *  This includes the time the server took to answer, not just the
+     *  network.
+     *
+     *  \return int64_t Microseconds, -1 until a heartbeat is answered.
+     */
+    int64_t getHeartbeatRtt();
+
+    /**
+     *  \brief Round trip times of every answered heartbeat.
+     *
+     *  \return LatencyHistogram A copy.
+     */
+    LatencyHistogram getHeartbeatRttHistogram();
+
+    /**
+     *  \brief Has the WebSocket send a PING every ms milliseconds.
+     *
+     *  PONGs are answered by the server's transport, so their round trip is
+     *  the network's alone. Set against the heartbeat round trip, which also
+     *  waits on the server's channel processes, it tells network delay from
+     *  server load. Only WebSockets that implement setPingInterval ping.
+     *
+     *  \param ms The interval in milliseconds, 0 to stop.
+     *  \return void
+     */
+    void setPingInterval(int ms);
+
+    /**
+     *  \brief Round trip times of PINGs on the current connection.
+     *
+     *  \return LatencyHistogram A copy.
+     */
+    LatencyHistogram getPingRtt();
+
+    /**
+     *  \brief Limits how fast every PhxSocket in the process may reconnect.
+     *
+     *  Attempts past the limit wait their turn after their backoff, so a
+     *  process holding many connections to one server doesn't reopen them
+     *  all in the same instant. Off by default.
+     *
+     *  \param perSecond Reconnects allowed per second, 0 for no limit.
+     *  \param burst Reconnects allowed at once before the rate applies.
+     *  \return void
+     */
+    static void setReconnectLimit(double perSecond, int burst);
+
     /**
      *  \brief Adds a callback on open.
      *
@@ -273,7 +531,9 @@ public:
     /**
      *  \brief Adds a callback on message.
      *
-     *  \param callback
+     *  \param callback Gets every message as a {"topic", "event", "payload",
+     *  "ref"} object, whichever serializer is in use. Under V2 it also has
+     *  "join_ref".
      *  \return void
      */
     void onMessage(OnMessage callback);
@@ -302,14 +562,194 @@ public:
     /**
      *  \brief Send data through websockets.
      *
+     *  data is sent as is, whatever the serializer.
+     *
      *  \param data The json data to send.
      *  \return void
      */
     void push(nlohmann::json data);
 
+    /**
+     *  \brief Send a message through websockets in the negotiated format.
+     *
+     *  \param topic The topic.
+     *  \param event The event.
+     *  \param payload The payload.
+     *  \param ref The ref of the message, -1 for none.
+     *  \param joinRef The ref of the channel's join, -1 for none.
+     *  \return void
+     */
+    void push(const std::string& topic,
+        const std::string& event,
+        const nlohmann::json& payload,
+        int64_t ref,
+        int64_t joinRef = -1);
+
+    /**
+     *  \brief Like push, for a payload that is already JSON text.
+     *
+     *  The payload is spliced into the envelope untouched.
+     *
+     *  \param topic The topic.
+     *  \param event The event.
+     *  \param payload The payload's JSON text.
+     *  \param ref The ref of the message, -1 for none.
+     *  \param joinRef The ref of the channel's join, -1 for none.
+     *  \return void
+     */
+    void pushRaw(const std::string& topic,
+        const std::string& event,
+        const std::string& payload,
+        int64_t ref,
+        int64_t joinRef = -1);
+
+    /**
+     *  \brief Selects the envelope format, V1 by default.
+     *
+     *  Takes effect on the next connect, which announces it to the server
+     *  with a vsn param. A vsn given in the URL or connect params wins.
+     *
+     *  \param version The format to use.
+     *  \return void
+     */
+    void setSerializerVersion(SerializerVersion version);
+
+    /**
+     *  \brief Batches pushes made within us microseconds of each other.
+     *
+     *  Pushes are coalesced into one write whenever they queue up faster
+     *  than the socket drains them. A window holds each batch open that long
+     *  past its first push, so a burst spread over a few microseconds still
+     *  costs one syscall, at the price of that much added latency. 0, the
+     *  default, holds nothing back.
+     *
+     *  \param us The batching window in microseconds.
+     *  \return void
+     */
+    void setBatchWindow(int64_t us);
+
+    /**
+     *  \brief Sends pushes held back by the batching window right away.
+     *
+     *  \return void
+     */
+    void flush();
+
+    /**
+     *  \brief Frames and write syscalls for the current connection.
+     *
+     *  \return SendStats
+     */
+    SendStats getSendStats();
+
+    /**
+     *  \brief Holds pushes made while disconnected until their channel
+     *  rejoins.
+     *
+     *  A push is held if the socket isn't open, or if earlier pushes to its
+     *  topic are still held. Held pushes are sent in order, with the new
+     *  join_ref, when the channel's join succeeds; their replies and timeouts
+     *  work as if they had been sent late. Joins and leaves are never held,
+     *  since the channel redoes them itself.
+     *
+     *  \param capacity Pushes held at most, 0 (the default) to drop pushes
+     *  made while disconnected.
+     *  \param ttlMs Milliseconds a push is held at most, 0 for no limit.
+     *  \param policy Whether to drop the oldest held push or the new one
+     *  when full.
+     *  \return void
+     */
+    void setOutbox(size_t capacity,
+        int ttlMs,
+        OutboxPolicy policy = OutboxPolicy::DropOldest);
+
+    /**
+     *  \brief Holds pushes to topic in the outbox until replayOutbox.
+     *
+     *  Called by PhxChannel when it stops being joined, so that pushes made
+     *  once the socket is back but before the rejoin completes don't go out
+     *  under a stale join_ref.
+     *
+     *  \param topic The channel's topic.
+     *  \return void
+     */
+    void holdOutbox(const std::string& topic);
+
+    /**
+     *  \brief Sends the pushes held for topic, now that it has rejoined.
+     *
+     *  Called by PhxChannel when its join succeeds.
+     *
+     *  \param topic The channel's topic.
+     *  \param joinRef The ref of the join that succeeded.
+     *  \return void
+     */
+    void replayOutbox(const std::string& topic, int64_t joinRef);
+
+    /**
+     *  \brief Number of pushes held in the outbox.
+     *
+     *  \return size_t
+     */
+    size_t getOutboxDepth();
+
+    /**
+     *  \brief Pushes the outbox has dropped, when full or for their TTL.
+     *
+     *  \return uint64_t
+     */
+    uint64_t getOutboxDropped();
+
+    /**
+     *  \brief Calls callback once when the phx_reply for ref arrives.
+     *
+     *  The callback runs on this socket's thread. It is dropped without being
+     *  called if offReply is called first or the connection closes, since a
+     *  reply can't arrive after that.
+     *
+     *  \param ref The ref the message was pushed with.
+     *  \param callback Called with the reply's payload, which it may keep,
+     *  and ref.
+     *  \return void
+     */
+    void onReply(int64_t ref, OnReply callback);
+
+    /**
+     *  \brief Stops waiting on the reply for ref.
+     *
+     *  \param ref The ref passed to onReply.
+     *  \return void
+     */
+    void offReply(int64_t ref);
+
+    /**
+     *  \brief Runs callback on this socket's thread after ms milliseconds.
+     *
+     *  The timer lives on TimerWheel::shared(), so pending timeouts don't
+     *  cost a thread each.
+     *
+     *  \param ms Milliseconds to wait.
+     *  \param callback The callback to run.
+     *  \return TimerWheel::TimerId Pass to cancelTimeout to stop the timer.
+     */
+    TimerWheel::TimerId setTimeout(int ms, After callback);
+
+    /**
+     *  \brief Cancels a timer started with setTimeout.
+     *
+     *  A callback already handed to this socket's thread may still run.
+     *
+     *  \param id The timer to cancel.
+     *  \return void
+     */
+    void cancelTimeout(TimerWheel::TimerId id);
+
     /**
      *  \brief Adds PhxChannel to list of channels.
      *
+     *  Safe to call from any thread; takes effect on this socket's thread.
+     *  Adding a channel that is already present does nothing.
+     *
      *  \return void
      */
     void addChannel(std::shared_ptr<PhxChannel> channel);
@@ -317,6 +757,8 @@ public:
     /**
      *  \brief Removes PhxChannel from list of channels.
      *
+     *  Safe to call from any thread; takes effect on this socket's thread.
+     *
      *  \return void
      */
     void removeChannel(std::shared_ptr<PhxChannel> channel);
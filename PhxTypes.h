@@ -3,15 +3,26 @@
 #define PhxTypes_H
 #include "json.hpp"
 #include <functional>
+#include <memory>
 #include <string>
 
 enum class ChannelState { CLOSED, ERRORED, JOINING, JOINED };
 
+enum class SerializerVersion { V1, V2 };
+
+enum class OutboxPolicy { DropOldest, DropNewest };
+
 using OnOpen = std::function<void()>;
 using OnClose = std::function<void(const std::string& event)>;
 using OnError = std::function<void(const std::string& error)>;
-using OnMessage = std::function<void(nlohmann::json json)>;
-using OnReceive = std::function<void(nlohmann::json message, int64_t ref)>;
+using OnMessage = std::function<void(const nlohmann::json& json)>;
+using OnReceive
+    = std::function<void(const nlohmann::json& message, int64_t ref)>;
 using After = std::function<void()>;
 
+// A received payload, parsed once and shared by everything it is dispatched
+// to, so handlers that keep it don't have to copy it.
+using Payload = std::shared_ptr<const nlohmann::json>;
+using OnReply = std::function<void(const Payload& payload, int64_t ref)>;
+
 #endif
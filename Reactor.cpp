@@ -0,0 +1,435 @@
+#include "Reactor.h"
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+Reactor& Reactor::shared() {
+    static Reactor reactor;
+    return reactor;
+}
+
+Reactor* Reactor::running() {
+    Reactor& reactor = Reactor::shared();
+    return reactor.isRunning() ? &reactor : nullptr;
+}
+
+Reactor::Reactor()
+    : started(false)
+    , nextId(1) {
+}
+
+bool Reactor::isRunning() {
+    return this->started;
+}
+
+size_t Reactor::getThreadCount() {
+    return this->started ? this->loops.size() : 0;
+}
+
+#ifdef __linux__
+
+namespace {
+
+/*!< epoll data of the descriptors every loop watches itself. Watch ids
+  are never 0 and never get near the top of the range. */
+const uint64_t EVENT_KEY = 0;
+const uint64_t TIMER_KEY = UINT64_MAX;
+
+/*!< The clock timerfd counts in, which steady_clock also uses. */
+int64_t monotonicMicros() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
+
+bool addFd(int epollFd, int fd, uint64_t key) {
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = key;
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+void closeFd(int fd) {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+} // namespace
+
+Reactor::~Reactor() {
+    for (Loop* loop : this->loops) {
+        {
+            std::lock_guard<std::mutex> guard(loop->mutex);
+            loop->stop = true;
+            loop->sleeping = true;
+            this->notify(loop);
+        }
+        if (loop->thread.joinable()) {
+            loop->thread.join();
+        }
+    }
+
+    for (Loop* loop : this->loops) {
+        // Dropping a watch can destroy the socket holding it, so not under
+        // the lock.
+        std::unordered_map<WatchId, std::shared_ptr<Watch>> watches;
+        std::vector<std::shared_ptr<Watch>> retired;
+        {
+            std::lock_guard<std::mutex> guard(loop->mutex);
+            watches.swap(loop->watches);
+            retired.swap(loop->retired);
+        }
+        watches.clear();
+        retired.clear();
+    }
+
+    for (Loop* loop : this->loops) {
+        closeFd(loop->epollFd);
+        closeFd(loop->eventFd);
+        closeFd(loop->timerFd);
+        delete loop;
+    }
+}
+
+bool Reactor::start(size_t threads) {
+    std::lock_guard<std::mutex> guard(this->mutex);
+    if (this->started) {
+        return false;
+    }
+
+    std::vector<Loop*> loops;
+    bool ok = true;
+    for (size_t i = 0; i < std::max<size_t>(threads, 1); i++) {
+        Loop* loop = new Loop();
+        loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        loop->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        loop->timerFd
+            = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        loop->sleeping = false;
+        loop->stop = false;
+        loop->exited = false;
+        loops.push_back(loop);
+        if (loop->epollFd < 0 || loop->eventFd < 0 || loop->timerFd < 0
+            || !addFd(loop->epollFd, loop->eventFd, EVENT_KEY)
+            || !addFd(loop->epollFd, loop->timerFd, TIMER_KEY)) {
+            ok = false;
+            break;
+        }
+    }
+
+    if (!ok) {
+        for (Loop* loop : loops) {
+            closeFd(loop->epollFd);
+            closeFd(loop->eventFd);
+            closeFd(loop->timerFd);
+            delete loop;
+        }
+        return false;
+    }
+
+    this->loops = loops;
+    for (Loop* loop : this->loops) {
+        loop->thread = std::thread(&Reactor::run, this, loop);
+    }
+
+    this->started = true;
+    return true;
+}
+
+Reactor::WatchId Reactor::watch(
+    int fd, std::function<void()> onReady, const void* key) {
+    if (!this->started) {
+        return 0;
+    }
+
+    // The id records which loop the watch lives on.
+    size_t index = this->indexOf(key);
+    Loop* loop = this->loops[index];
+    WatchId id = this->nextId++ * this->loops.size() + index;
+
+    std::shared_ptr<Watch> watch = std::make_shared<Watch>();
+    watch->onReady = std::move(onReady);
+    watch->woken = false;
+    watch->retired = false;
+    {
+        std::lock_guard<std::mutex> guard(loop->mutex);
+        loop->watches[id] = watch;
+    }
+
+    // Edge triggered, so an idle connection costs nothing until it changes.
+    epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.u64 = id;
+    if (epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        this->unwatch(id);
+        return 0;
+    }
+
+    return id;
+}
+
+void Reactor::wake(WatchId id, int64_t delayUs) {
+    if (!id || !this->started) {
+        return;
+    }
+
+    Loop* loop = this->loopOf(id);
+    std::lock_guard<std::mutex> guard(loop->mutex);
+    if (delayUs <= 0) {
+        this->markWoken(loop, id);
+        return;
+    }
+
+    int64_t due = monotonicMicros() + delayUs;
+    loop->delayed.push_back(std::make_pair(due, id));
+    std::push_heap(loop->delayed.begin(), loop->delayed.end(),
+        std::greater<std::pair<int64_t, WatchId>>());
+    if (loop->delayed.front().first == due) {
+        this->armTimer(loop);
+    }
+}
+
+void Reactor::unwatch(WatchId id) {
+    if (!id || !this->started) {
+        return;
+    }
+
+    // The watch may hold the last reference to its socket, whose executor
+    // could be queued or mid-drain on this very loop, so the loop releases
+    // it between passes.
+    Loop* loop = this->loopOf(id);
+    std::lock_guard<std::mutex> guard(loop->mutex);
+    auto it = loop->watches.find(id);
+    if (it == loop->watches.end()) {
+        return;
+    }
+
+    it->second->retired = true;
+    loop->retired.push_back(std::move(it->second));
+    loop->watches.erase(it);
+    this->notify(loop);
+}
+
+void Reactor::schedule(SerialExecutor* executor) {
+    Loop* loop = this->loops[this->indexOf(executor)];
+    std::lock_guard<std::mutex> guard(loop->mutex);
+    loop->executors.push_back(executor);
+    this->notify(loop);
+}
+
+bool Reactor::unschedule(SerialExecutor* executor) {
+    Loop* loop = this->loops[this->indexOf(executor)];
+    std::lock_guard<std::mutex> guard(loop->mutex);
+    if (!loop->exited && std::this_thread::get_id() != loop->threadId) {
+        return false;
+    }
+
+    loop->executors.erase(std::remove(loop->executors.begin(),
+                              loop->executors.end(), executor),
+        loop->executors.end());
+
+    // Only reachable on the loop's own thread, or once it has exited, so
+    // this can't race the pass that is walking it.
+    std::replace(loop->draining.begin(), loop->draining.end(), executor,
+        static_cast<SerialExecutor*>(nullptr));
+    return true;
+}
+
+size_t Reactor::indexOf(const void* key) {
+    // Fibonacci hashing, since aligned addresses share their low bits.
+    uint64_t hash = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(key))
+        * 0x9E3779B97F4A7C15ull;
+    return (hash >> 32) % this->loops.size();
+}
+
+Reactor::Loop* Reactor::loopOf(WatchId id) {
+    return this->loops[id % this->loops.size()];
+}
+
+void Reactor::notify(Loop* loop) {
+    if (loop->sleeping) {
+        loop->sleeping = false;
+        uint64_t one = 1;
+        ssize_t written = ::write(loop->eventFd, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+void Reactor::markWoken(Loop* loop, WatchId id) {
+    auto it = loop->watches.find(id);
+    if (it != loop->watches.end() && !it->second->woken) {
+        it->second->woken = true;
+        loop->woken.push_back(id);
+        this->notify(loop);
+    }
+}
+
+void Reactor::armTimer(Loop* loop) {
+    itimerspec spec = {};
+    if (!loop->delayed.empty()) {
+        // A zero time would disarm it, and one in the past fires at once.
+        int64_t due = std::max<int64_t>(loop->delayed.front().first, 1);
+        spec.it_value.tv_sec = due / 1000000;
+        spec.it_value.tv_nsec = (due % 1000000) * 1000;
+    }
+    timerfd_settime(loop->timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+void Reactor::fireDelayed(Loop* loop) {
+    int64_t now = monotonicMicros();
+    while (!loop->delayed.empty() && loop->delayed.front().first <= now) {
+        WatchId id = loop->delayed.front().second;
+        std::pop_heap(loop->delayed.begin(), loop->delayed.end(),
+            std::greater<std::pair<int64_t, WatchId>>());
+        loop->delayed.pop_back();
+        this->markWoken(loop, id);
+    }
+    this->armTimer(loop);
+}
+
+void Reactor::run(Loop* loop) {
+    epoll_event events[REACTOR_EVENTS];
+    std::vector<WatchId> woken;
+    std::vector<std::shared_ptr<Watch>> ready;
+    std::vector<std::shared_ptr<Watch>> retired;
+    {
+        std::lock_guard<std::mutex> guard(loop->mutex);
+        loop->threadId = std::this_thread::get_id();
+    }
+
+    for (;;) {
+        bool idle;
+        {
+            std::lock_guard<std::mutex> guard(loop->mutex);
+            retired.swap(loop->retired);
+        }
+
+        // Nothing is running, so it's safe for a socket to go here.
+        retired.clear();
+
+        {
+            std::lock_guard<std::mutex> guard(loop->mutex);
+            if (loop->stop) {
+                break;
+            }
+
+            idle = loop->woken.empty() && loop->executors.empty()
+                && loop->retired.empty();
+            loop->sleeping = idle;
+        }
+
+        int count = epoll_wait(
+            loop->epollFd, events, REACTOR_EVENTS, idle ? -1 : 0);
+
+        {
+            std::lock_guard<std::mutex> guard(loop->mutex);
+            loop->sleeping = false;
+            for (int i = 0; i < count; i++) {
+                uint64_t key = events[i].data.u64;
+                if (key == EVENT_KEY) {
+                    uint64_t value;
+                    ssize_t got = ::read(loop->eventFd, &value, sizeof(value));
+                    (void)got;
+                } else if (key == TIMER_KEY) {
+                    uint64_t expirations;
+                    ssize_t got = ::read(
+                        loop->timerFd, &expirations, sizeof(expirations));
+                    (void)got;
+                    this->fireDelayed(loop);
+                } else {
+                    this->markWoken(loop, key);
+                }
+            }
+
+            woken.swap(loop->woken);
+            loop->draining.swap(loop->executors);
+
+            // Cleared before running, so a wake from here on runs it again.
+            for (WatchId id : woken) {
+                auto it = loop->watches.find(id);
+                if (it != loop->watches.end()) {
+                    it->second->woken = false;
+                    ready.push_back(it->second);
+                }
+            }
+        }
+
+        // An earlier callback this pass may have dropped a later watch.
+        for (const std::shared_ptr<Watch>& watch : ready) {
+            if (!watch->retired) {
+                watch->onReady();
+            }
+        }
+        ready.clear();
+        woken.clear();
+
+        this->drainAll(loop);
+    }
+
+    // Run what's left, so no hosted executor waits on a drain that never
+    // comes.
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> guard(loop->mutex);
+            if (loop->executors.empty()) {
+                loop->exited = true;
+                break;
+            }
+
+            loop->draining.swap(loop->executors);
+        }
+
+        this->drainAll(loop);
+    }
+}
+
+void Reactor::drainAll(Loop* loop) {
+    // Indexed, and re-read each time, since a task can destroy an executor
+    // further along, which unschedule() marks with nullptr.
+    for (size_t i = 0; i < loop->draining.size(); i++) {
+        SerialExecutor* executor = loop->draining[i];
+        if (executor && executor->drain(REACTOR_DRAIN_BUDGET)) {
+            std::lock_guard<std::mutex> guard(loop->mutex);
+            loop->executors.push_back(executor);
+        }
+    }
+
+    std::lock_guard<std::mutex> guard(loop->mutex);
+    loop->draining.clear();
+}
+
+#else
+
+Reactor::~Reactor() {
+}
+
+bool Reactor::start(size_t threads) {
+    return false;
+}
+
+Reactor::WatchId Reactor::watch(
+    int fd, std::function<void()> onReady, const void* key) {
+    return 0;
+}
+
+void Reactor::wake(WatchId id, int64_t delayUs) {
+}
+
+void Reactor::unwatch(WatchId id) {
+}
+
+void Reactor::schedule(SerialExecutor* executor) {
+}
+
+bool Reactor::unschedule(SerialExecutor* executor) {
+    return true;
+}
+
+#endif
@@ -0,0 +1,211 @@
+/**
+ *   \file Reactor.h
+ *   \brief A few epoll threads that service every connection in the process.
+ *
+ *  Without it, each EasySocket polls on a thread of its own and each
+ *  SerialExecutor runs on another, which is three threads per PhxSocket.
+ *  Once the shared reactor is started, sockets made afterwards register
+ *  their file descriptors with it and host their executors on it instead,
+ *  so the process runs on a fixed number of threads however many
+ *  connections it holds.
+ *
+ *  Each thread owns an epoll set and a share of the watches and executors.
+ *  Everything on a thread takes turns, so callbacks run on it must not
+ *  block: a slow callback holds up every connection on the same thread.
+ *
+ *  Linux only. Elsewhere start() fails and sockets keep their own threads.
+ */
+#ifndef Reactor_H
+#define Reactor_H
+
+#include "SerialExecutor.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*!< Most tasks an executor runs before the next one gets a turn. */
+#define REACTOR_DRAIN_BUDGET 64
+
+/*!< Most epoll events taken per wait. */
+#define REACTOR_EVENTS 256
+
+class Reactor : public ExecutorHost {
+public:
+    /*!< Identifies a watched file descriptor. 0 is never a valid id. */
+    typedef uint64_t WatchId;
+
+    /**
+     *  \brief The process-wide reactor. Idle until started.
+     *
+     *  \return Reactor&
+     */
+    static Reactor& shared();
+
+    /**
+     *  \brief The shared reactor if it has been started.
+     *
+     *  \return Reactor* nullptr if sockets should use threads of their own.
+     */
+    static Reactor* running();
+
+    Reactor();
+
+    ~Reactor();
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    /**
+     *  \brief Starts the service threads.
+     *
+     *  Only sockets made after this use the reactor.
+     *
+     *  \param threads Number of threads, at least 1.
+     *  \return bool False if already started or epoll isn't available.
+     */
+    bool start(size_t threads);
+
+    /**
+     *  \brief Whether start() succeeded.
+     *
+     *  \return bool
+     */
+    bool isRunning();
+
+    /**
+     *  \brief Number of service threads, 0 if not started.
+     *
+     *  \return size_t
+     */
+    size_t getThreadCount();
+
+    /**
+     *  \brief Calls onReady whenever fd may be readable or writable.
+     *
+     *  Readiness is edge triggered, so onReady must read and write until
+     *  the descriptor would block. Closing fd stops the events; call
+     *  unwatch() to drop onReady.
+     *
+     *  \param fd A non-blocking descriptor.
+     *  \param onReady Run on the service thread key maps to.
+     *  \param key Picks the thread. Passing the address of a hosted
+     *  SerialExecutor puts the watch on the executor's thread.
+     *  \return WatchId 0 if the descriptor couldn't be added.
+     */
+    WatchId watch(int fd, std::function<void()> onReady, const void* key);
+
+    /**
+     *  \brief Calls a watch's onReady as if its descriptor were ready.
+     *
+     *  Safe from any thread. Wakes that are already pending are merged.
+     *
+     *  \param id The watch. 0 is ignored.
+     *  \param delayUs Microseconds to wait first, 0 for now.
+     *  \return void
+     */
+    void wake(WatchId id, int64_t delayUs = 0);
+
+    /**
+     *  \brief Drops a watch. Safe from any thread, including its onReady.
+     *
+     *  onReady won't be called again, though a call already under way
+     *  finishes. It is only destroyed at the start of the loop's next pass,
+     *  outside any callback. Whatever it holds, such as the socket it
+     *  services, stays alive until the tasks queued on the loop by now have
+     *  run.
+     *
+     *  \param id The watch. 0 is ignored.
+     *  \return void
+     */
+    void unwatch(WatchId id);
+
+    // ExecutorHost
+    void schedule(SerialExecutor* executor);
+    bool unschedule(SerialExecutor* executor);
+    // ExecutorHost
+
+private:
+    struct Watch {
+        std::function<void()> onReady;
+
+        /*!< Set while the watch is queued to run. Guarded by Loop::mutex. */
+        bool woken;
+
+        /*!< Set by unwatch(), so a pass that has already picked the watch
+          up skips it. */
+        std::atomic<bool> retired;
+    };
+
+    struct Loop {
+        int epollFd;
+
+        /*!< Readable when there's something queued for the thread. */
+        int eventFd;
+
+        /*!< Readable when the earliest delayed wake is due. */
+        int timerFd;
+
+        std::mutex mutex;
+
+        std::unordered_map<WatchId, std::shared_ptr<Watch>> watches;
+
+        /*!< Watches waiting to run. */
+        std::vector<WatchId> woken;
+
+        /*!< Executors waiting to be drained. */
+        std::vector<SerialExecutor*> executors;
+
+        /*!< Executors being drained this pass. Only touched by the thread.
+          unschedule() nulls out any destroyed mid-pass. */
+        std::vector<SerialExecutor*> draining;
+
+        /*!< Unwatched watches, released at the start of the next pass. */
+        std::vector<std::shared_ptr<Watch>> retired;
+
+        /*!< Delayed wakes as a min-heap of (due microseconds, watch). */
+        std::vector<std::pair<int64_t, WatchId>> delayed;
+
+        /*!< Set while the thread is, or is about to be, waiting on epoll
+          with nothing queued. Whoever queues something clears it and
+          signals eventFd. */
+        bool sleeping;
+
+        bool stop;
+
+        /*!< Set once the thread won't drain anything more. */
+        bool exited;
+
+        /*!< The service thread, set once it starts. */
+        std::thread::id threadId;
+
+        std::thread thread;
+    };
+
+    /*!< Fixed once started. */
+    std::vector<Loop*> loops;
+
+    /*!< Guards loops while starting and stopping. */
+    std::mutex mutex;
+
+    std::atomic<bool> started;
+
+    std::atomic<WatchId> nextId;
+
+    size_t indexOf(const void* key);
+    Loop* loopOf(WatchId id);
+    void notify(Loop* loop);
+    void markWoken(Loop* loop, WatchId id);
+    void armTimer(Loop* loop);
+    void fireDelayed(Loop* loop);
+    void drainAll(Loop* loop);
+    void run(Loop* loop);
+};
+
+#endif // Reactor_H
@@ -0,0 +1,470 @@
+/**
+ *   \file SerialExecutor.h
+ *   \brief Runs posted tasks one at a time, in order, on a single thread.
+ *
+ *  post() is fire-and-forget: there is no future to hand back, and a task
+ *  whose callable fits in EXECUTOR_TASK_SIZE bytes is constructed straight
+ *  into a slot of a bounded lock-free ring (Dmitry Vyukov's sequence-numbered
+ *  queue), so the common case doesn't allocate or take a lock. Bursts that
+ *  outrun the ring spill into a locked overflow list instead of blocking the
+ *  poster, which keeps it safe to post from the executor's own thread.
+ *
+ *  Given an ExecutorHost, the executor has no thread of its own: it asks
+ *  the host to drain it whenever posting makes it go from idle to busy, so
+ *  any number of executors can share the host's few threads. Tasks still
+ *  run one at a time and in order.
+ */
+#ifndef SerialExecutor_H
+#define SerialExecutor_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+/*!< Largest callable stored inline; bigger ones are boxed on the heap. */
+#define EXECUTOR_TASK_SIZE 64
+
+/*!< Number of slots in the ring. Must be a power of two. */
+#define EXECUTOR_CAPACITY 1024
+
+class SerialExecutor;
+
+/**
+ *  Threads that hosted SerialExecutors run on. See Reactor.
+ */
+class ExecutorHost {
+public:
+    virtual ~ExecutorHost() {
+    }
+
+    /**
+     *  \brief Has executor->drain() called on one of the host's threads.
+     *
+     *  An executor is only ever scheduled once at a time.
+     *
+     *  \param executor The executor with tasks to run.
+     *  \return void
+     */
+    virtual void schedule(SerialExecutor* executor) = 0;
+
+    /**
+     *  \brief Takes back a scheduled executor that is being destroyed.
+     *
+     *  \param executor The executor.
+     *  \return bool True if the host won't drain it, in which case the
+     *  caller runs what's left. False if another thread will, and the caller
+     *  should wait for it.
+     */
+    virtual bool unschedule(SerialExecutor* executor) = 0;
+};
+
+class SerialExecutor {
+private:
+    /**
+     *  A type-erased void() callable with inline storage.
+     */
+    class Task {
+    private:
+        struct Ops {
+            void (*invoke)(void* storage);
+            void (*relocate)(void* from, void* to);
+            void (*destroy)(void* storage);
+        };
+
+        template <typename F>
+        struct Inline {
+            static void invoke(void* storage) {
+                (*static_cast<F*>(storage))();
+            }
+
+            static void relocate(void* from, void* to) {
+                new (to) F(std::move(*static_cast<F*>(from)));
+                static_cast<F*>(from)->~F();
+            }
+
+            static void destroy(void* storage) {
+                static_cast<F*>(storage)->~F();
+            }
+
+            static const Ops* ops() {
+                static const Ops ops = { &invoke, &relocate, &destroy };
+                return &ops;
+            }
+        };
+
+        template <typename F>
+        struct Boxed {
+            static void invoke(void* storage) {
+                (**static_cast<F**>(storage))();
+            }
+
+            static void relocate(void* from, void* to) {
+                *static_cast<F**>(to) = *static_cast<F**>(from);
+            }
+
+            static void destroy(void* storage) {
+                delete *static_cast<F**>(storage);
+            }
+
+            static const Ops* ops() {
+                static const Ops ops = { &invoke, &relocate, &destroy };
+                return &ops;
+            }
+        };
+
+        typename std::aligned_storage<EXECUTOR_TASK_SIZE>::type storage;
+        const Ops* ops;
+
+        template <typename F, typename Arg>
+        void emplace(Arg&& f, std::true_type) {
+            new (&this->storage) F(std::forward<Arg>(f));
+            this->ops = Inline<F>::ops();
+        }
+
+        template <typename F, typename Arg>
+        void emplace(Arg&& f, std::false_type) {
+            *reinterpret_cast<F**>(&this->storage)
+                = new F(std::forward<Arg>(f));
+            this->ops = Boxed<F>::ops();
+        }
+
+    public:
+        Task()
+            : ops(nullptr) {
+        }
+
+        Task(Task&& other)
+            : ops(other.ops) {
+            if (this->ops) {
+                this->ops->relocate(&other.storage, &this->storage);
+                other.ops = nullptr;
+            }
+        }
+
+        Task& operator=(Task&& other) {
+            if (this != &other) {
+                this->reset();
+                this->ops = other.ops;
+                if (this->ops) {
+                    this->ops->relocate(&other.storage, &this->storage);
+                    other.ops = nullptr;
+                }
+            }
+
+            return *this;
+        }
+
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+
+        ~Task() {
+            this->reset();
+        }
+
+        template <typename Arg>
+        void emplace(Arg&& f) {
+            typedef typename std::decay<Arg>::type F;
+            this->emplace<F>(std::forward<Arg>(f),
+                std::integral_constant<bool,
+                    sizeof(F) <= sizeof(this->storage)
+                        && std::alignment_of<F>::value
+                            <= std::alignment_of<decltype(
+                                   this->storage)>::value>());
+        }
+
+        void operator()() {
+            this->ops->invoke(&this->storage);
+        }
+
+        void reset() {
+            if (this->ops) {
+                this->ops->destroy(&this->storage);
+                this->ops = nullptr;
+            }
+        }
+    };
+
+    struct Cell {
+        /*!< Equals the ring position when free, position + 1 when full. */
+        std::atomic<size_t> sequence;
+        Task task;
+    };
+
+    /*!< The ring. */
+    Cell* cells;
+
+    /*!< Next position producers claim. */
+    std::atomic<size_t> enqueuePos;
+
+    /*!< Next position the worker runs. Only touched by the worker. */
+    size_t dequeuePos;
+
+    /*!< Tasks posted while the ring was full, or while this wasn't empty. */
+    std::deque<Task> overflow;
+
+    /*!< Size of overflow, readable without the lock. */
+    std::atomic<size_t> overflowCount;
+
+    /*!< Guards overflow, stop and sleeping transitions. */
+    std::mutex mutex;
+
+    std::condition_variable condition;
+
+    /*!< Set by the worker before it waits; posters only notify if set. */
+    std::atomic<bool> sleeping;
+
+    bool stop;
+
+    /*!< Runs the tasks if set, in place of worker. */
+    ExecutorHost* host;
+
+    /*!< Set while the executor is queued on or being drained by host. */
+    std::atomic<bool> scheduled;
+
+    std::thread worker;
+
+    /**
+     *  \brief Constructs f into a free slot of the ring.
+     *
+     *  \param f The callable, only moved from on success.
+     *  \return bool False if the ring was full.
+     */
+    template <typename F>
+    bool tryPush(F&& f) {
+        size_t pos = this->enqueuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &this->cells[pos & (EXECUTOR_CAPACITY - 1)];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (this->enqueuePos.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = this->enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->task.emplace(std::forward<F>(f));
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     *  \brief Runs the oldest task in the ring, in place.
+     *
+     *  \return bool Whether there was one.
+     */
+    bool runRing() {
+        Cell* cell = &this->cells[this->dequeuePos & (EXECUTOR_CAPACITY - 1)];
+        if (cell->sequence.load(std::memory_order_acquire)
+            != this->dequeuePos + 1) {
+            return false;
+        }
+
+        cell->task();
+        cell->task.reset();
+        cell->sequence.store(
+            this->dequeuePos + EXECUTOR_CAPACITY, std::memory_order_release);
+        this->dequeuePos++;
+        return true;
+    }
+
+    /**
+     *  \brief Runs the oldest spilled task.
+     *
+     *  \return bool Whether there was one.
+     */
+    bool runOverflow() {
+        if (this->overflowCount.load(std::memory_order_acquire) == 0) {
+            return false;
+        }
+
+        Task task;
+        {
+            std::lock_guard<std::mutex> guard(this->mutex);
+            task = std::move(this->overflow.front());
+            this->overflow.pop_front();
+            this->overflowCount.fetch_sub(1, std::memory_order_release);
+        }
+
+        task();
+        return true;
+    }
+
+    /**
+     *  \brief Whether anything is waiting to run.
+     *
+     *  \return bool
+     */
+    bool hasTasks() {
+        Cell* cell = &this->cells[this->dequeuePos & (EXECUTOR_CAPACITY - 1)];
+        return cell->sequence.load(std::memory_order_acquire)
+                   == this->dequeuePos + 1
+            || this->overflowCount.load(std::memory_order_acquire) != 0;
+    }
+
+    void run() {
+        for (;;) {
+            // Spilled tasks are newer than anything left in the ring.
+            if (this->runRing() || this->runOverflow()) {
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->sleeping.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            Cell* cell
+                = &this->cells[this->dequeuePos & (EXECUTOR_CAPACITY - 1)];
+            if (cell->sequence.load(std::memory_order_acquire)
+                    == this->dequeuePos + 1
+                || !this->overflow.empty()) {
+                this->sleeping.store(false);
+                continue;
+            }
+
+            // The queue is drained, so it's safe to go.
+            if (this->stop) {
+                return;
+            }
+
+            this->condition.wait(
+                lock, [this]() { return !this->sleeping || this->stop; });
+            this->sleeping.store(false);
+        }
+    }
+
+public:
+    /**
+     *  \brief Constructor
+     *
+     *  \param host Runs the tasks, or nullptr to start a thread for them.
+     *  \return SerialExecutor
+     */
+    explicit SerialExecutor(ExecutorHost* host = nullptr)
+        : cells(new Cell[EXECUTOR_CAPACITY])
+        , enqueuePos(0)
+        , dequeuePos(0)
+        , overflowCount(0)
+        , sleeping(false)
+        , stop(false)
+        , host(host)
+        , scheduled(false) {
+        static_assert((EXECUTOR_CAPACITY & (EXECUTOR_CAPACITY - 1)) == 0,
+            "EXECUTOR_CAPACITY must be a power of two");
+        for (size_t i = 0; i < EXECUTOR_CAPACITY; i++) {
+            this->cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        if (!this->host) {
+            this->worker = std::thread(&SerialExecutor::run, this);
+        }
+    }
+
+    /**
+     *  \brief Runs every task already posted, then stops the worker.
+     */
+    ~SerialExecutor() {
+        if (this->host) {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->stop = true;
+            if (this->scheduled && this->host->unschedule(this)) {
+                lock.unlock();
+                while (this->runRing() || this->runOverflow()) {
+                }
+            } else {
+                this->condition.wait(
+                    lock, [this]() { return !this->scheduled; });
+            }
+        } else {
+            {
+                std::lock_guard<std::mutex> guard(this->mutex);
+                this->stop = true;
+            }
+            this->condition.notify_one();
+            this->worker.join();
+        }
+        delete[] this->cells;
+    }
+
+    SerialExecutor(const SerialExecutor&) = delete;
+    SerialExecutor& operator=(const SerialExecutor&) = delete;
+
+    /**
+     *  \brief Queues f to run on the executor's thread. Safe from any thread.
+     *
+     *  \param f A callable taking no arguments. Its result is discarded.
+     *  \return void
+     */
+    template <typename F>
+    void post(F&& f) {
+        // Once anything has spilled, keep spilling so tasks stay in order.
+        if (this->overflowCount.load(std::memory_order_acquire) != 0
+            || !this->tryPush(std::forward<F>(f))) {
+            std::lock_guard<std::mutex> guard(this->mutex);
+            this->overflow.emplace_back();
+            this->overflow.back().emplace(std::forward<F>(f));
+            this->overflowCount.fetch_add(1, std::memory_order_release);
+        }
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (this->host) {
+            if (!this->scheduled.load(std::memory_order_relaxed)
+                && !this->scheduled.exchange(true)) {
+                this->host->schedule(this);
+            }
+            return;
+        }
+
+        if (this->sleeping.load(std::memory_order_relaxed)
+            && this->sleeping.exchange(false)) {
+            // Taking the lock orders this with the worker's predicate check.
+            { std::lock_guard<std::mutex> guard(this->mutex); }
+            this->condition.notify_one();
+        }
+    }
+
+    /**
+     *  \brief Runs queued tasks on the calling thread. Only for the host.
+     *
+     *  \param budget Most tasks to run before giving other executors a turn.
+     *  \return bool True if tasks are left, in which case the executor is
+     *  still scheduled and the host should call again. False if it has gone
+     *  idle; the host must not touch it after that.
+     */
+    bool drain(size_t budget) {
+        for (size_t ran = 0; ran < budget;) {
+            if (this->runRing() || this->runOverflow()) {
+                ran++;
+                continue;
+            }
+
+            // Going idle. A post that lands after the store schedules us
+            // again; one that landed before is seen by hasTasks(), and we
+            // keep going unless that post already rescheduled us.
+            std::lock_guard<std::mutex> guard(this->mutex);
+            this->scheduled.store(false);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!this->hasTasks() || this->scheduled.exchange(true)) {
+                // The destructor may return as soon as the lock is released.
+                this->condition.notify_all();
+                return false;
+            }
+        }
+
+        return true;
+    }
+};
+
+#endif // SerialExecutor_H
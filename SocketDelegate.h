@@ -27,15 +27,29 @@ public:
     /**
      *  \brief Callback received when Websocket receives a message.
      *
-     *  Detailed description
+     *  The message is passed by value so the WebSocket can move its receive
+     *  buffer in; implementations should move it on rather than copy it.
      *
-     *  \param param
-     *  \return return type
+     *  \param socket The WebSocket the message arrived on.
+     *  \param message The message, owned by the delegate.
+     *  \return void
      */
-    virtual void webSocketDidReceive(
-        WebSocket* socket, const std::string& message)
+    virtual void webSocketDidReceive(WebSocket* socket, std::string message)
         = 0;
 
+    /**
+     *  \brief Callback received when Websocket receives a PONG frame.
+     *
+     *  Optional; the default ignores it.
+     *
+     *  \param socket The WebSocket the PONG arrived on.
+     *  \param payload The PONG's payload, which echoes its PING's.
+     *  \return void
+     */
+    virtual void webSocketDidReceivePong(
+        WebSocket* socket, const std::string& payload) {
+    }
+
     /**
      *  \brief Callback received when Websocket has an error.
      *
@@ -0,0 +1,224 @@
+#include "TimerWheel.h"
+#include <algorithm>
+
+TimerWheel& TimerWheel::shared() {
+    static TimerWheel wheel;
+    return wheel;
+}
+
+TimerWheel::TimerWheel(int64_t tickMs, size_t slots)
+    : tick(tickMs)
+    , origin(std::chrono::steady_clock::now())
+    , slots(slots, nullptr) {
+    this->processed = 0;
+    this->wakeTick = 0;
+    this->running = 0;
+    this->nextId = 0;
+    this->stop = false;
+}
+
+TimerWheel::~TimerWheel() {
+    {
+        std::lock_guard<std::mutex> guard(this->mutex);
+        this->stop = true;
+    }
+    this->wakeup.notify_all();
+    if (this->thread.joinable()) {
+        this->thread.join();
+    }
+
+    // Cancelled timers still waiting in due are no longer in the map.
+    for (Timer* timer : this->due) {
+        if (timer->cancelled) {
+            delete timer;
+        }
+    }
+
+    for (auto& it : this->timers) {
+        delete it.second;
+    }
+}
+
+TimerWheel::TimerId TimerWheel::schedule(
+    int64_t ms, std::function<void()> callback, int64_t periodMs) {
+    const int64_t tickMs = this->tick.count();
+    const int64_t elapsedMs
+        = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - this->origin)
+              .count();
+
+    Timer* timer = new Timer();
+    timer->callback = std::move(callback);
+    timer->period = periodMs > 0 ? (periodMs + tickMs - 1) / tickMs : 0;
+    timer->due = false;
+    timer->cancelled = false;
+
+    std::lock_guard<std::mutex> guard(this->mutex);
+    // Round up so a timer never fires early.
+    timer->deadline = std::max<uint64_t>(
+        (elapsedMs + std::max<int64_t>(ms, 0) + tickMs - 1) / tickMs,
+        this->processed + 1);
+    timer->id = ++this->nextId;
+    this->timers[timer->id] = timer;
+    this->link(timer);
+
+    if (!this->thread.joinable()) {
+        this->thread = std::thread(&TimerWheel::run, this);
+    } else if (this->wakeTick == 0 || timer->deadline < this->wakeTick) {
+        this->wakeup.notify_one();
+    }
+
+    return timer->id;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    auto it = this->timers.find(id);
+    if (it == this->timers.end()) {
+        return false;
+    }
+
+    Timer* timer = it->second;
+    this->timers.erase(it);
+
+    if (id == this->running) {
+        // The runner frees it once the callback returns.
+        timer->cancelled = true;
+        bool pending = timer->period != 0;
+        if (std::this_thread::get_id() != this->thread.get_id()) {
+            this->finished.wait(
+                lock, [this, id]() { return this->running != id; });
+        }
+        return pending;
+    }
+
+    if (timer->due) {
+        timer->cancelled = true;
+    } else {
+        this->unlink(timer);
+        delete timer;
+    }
+
+    return true;
+}
+
+size_t TimerWheel::size() {
+    std::lock_guard<std::mutex> guard(this->mutex);
+    return this->timers.size();
+}
+
+// Private
+
+uint64_t TimerWheel::now() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - this->origin)
+               .count()
+        / this->tick.count();
+}
+
+void TimerWheel::link(Timer* timer) {
+    Timer*& head = this->slots[timer->deadline % this->slots.size()];
+    timer->prev = nullptr;
+    timer->next = head;
+    if (head) {
+        head->prev = timer;
+    }
+    head = timer;
+}
+
+void TimerWheel::unlink(Timer* timer) {
+    if (timer->prev) {
+        timer->prev->next = timer->next;
+    } else {
+        this->slots[timer->deadline % this->slots.size()] = timer->next;
+    }
+
+    if (timer->next) {
+        timer->next->prev = timer->prev;
+    }
+}
+
+void TimerWheel::collect(uint64_t tick) {
+    if (tick <= this->processed) {
+        return;
+    }
+
+    // After a long sleep, visiting each slot once is enough.
+    uint64_t from = this->processed + 1;
+    if (tick - this->processed > this->slots.size()) {
+        from = tick - this->slots.size() + 1;
+    }
+
+    for (uint64_t t = from; t <= tick; t++) {
+        Timer* timer = this->slots[t % this->slots.size()];
+        while (timer) {
+            Timer* next = timer->next;
+            if (timer->deadline <= tick) {
+                this->unlink(timer);
+                timer->due = true;
+                this->due.push_back(timer);
+            }
+            timer = next;
+        }
+    }
+
+    this->processed = tick;
+}
+
+uint64_t TimerWheel::nextBusyTick() {
+    for (uint64_t t = this->processed + 1;
+         t <= this->processed + this->slots.size();
+         t++) {
+        if (this->slots[t % this->slots.size()]) {
+            return t;
+        }
+    }
+
+    return 0;
+}
+
+void TimerWheel::run() {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (!this->stop) {
+        this->collect(this->now());
+
+        while (!this->due.empty()) {
+            Timer* timer = this->due.front();
+            this->due.pop_front();
+            if (timer->cancelled) {
+                delete timer;
+                continue;
+            }
+
+            this->running = timer->id;
+            lock.unlock();
+            timer->callback();
+            lock.lock();
+            this->running = 0;
+
+            if (timer->cancelled) {
+                delete timer;
+            } else if (timer->period) {
+                timer->due = false;
+                timer->deadline = std::max(
+                    timer->deadline + timer->period, this->processed + 1);
+                this->link(timer);
+            } else {
+                this->timers.erase(timer->id);
+                delete timer;
+            }
+
+            this->finished.notify_all();
+        }
+
+        this->wakeTick = this->nextBusyTick();
+        if (this->wakeTick == 0) {
+            this->wakeup.wait(lock);
+        } else {
+            this->wakeup.wait_until(
+                lock,
+                this->origin
+                    + this->tick * static_cast<int64_t>(this->wakeTick));
+        }
+    }
+}
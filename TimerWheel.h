@@ -0,0 +1,142 @@
+/**
+ *   \file TimerWheel.h
+ *   \brief A hashed timing wheel serviced by a single thread.
+ *
+ *  Heartbeats, reconnects and push timeouts all register here instead of
+ *  each sleeping on a thread of their own. Timers are bucketed by their
+ *  deadline tick into a fixed ring of slots, so scheduling and cancelling
+ *  are O(1). The service thread only wakes for ticks whose slot holds a
+ *  timer and sleeps indefinitely when none are pending.
+ */
+#ifndef TimerWheel_H
+#define TimerWheel_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#define TIMER_TICK_MS 10
+#define TIMER_SLOTS 512
+
+class TimerWheel {
+public:
+    /*!< Identifies a scheduled timer. 0 is never a valid id. */
+    typedef uint64_t TimerId;
+
+    /**
+     *  \brief The process-wide wheel shared by every PhxSocket.
+     *
+     *  \return TimerWheel&
+     */
+    static TimerWheel& shared();
+
+    /**
+     *  \brief Constructor
+     *
+     *  \param tickMs Resolution of the wheel in milliseconds.
+     *  \param slots Number of slots in the ring.
+     *  \return TimerWheel
+     */
+    TimerWheel(int64_t tickMs = TIMER_TICK_MS, size_t slots = TIMER_SLOTS);
+
+    ~TimerWheel();
+
+    /**
+     *  \brief Schedules callback to run on the wheel's thread.
+     *
+     *  Callbacks should be short; hand real work off to another thread.
+     *
+     *  \param ms Milliseconds until the callback fires.
+     *  \param callback The callback to run.
+     *  \param periodMs If positive, the timer re-arms itself every periodMs
+     *  milliseconds until cancelled.
+     *  \return TimerId
+     */
+    TimerId schedule(
+        int64_t ms, std::function<void()> callback, int64_t periodMs = 0);
+
+    /**
+     *  \brief Cancels a timer.
+     *
+     *  If the callback is running on the wheel's thread, this waits for it
+     *  to return (unless called from that callback), so once cancel returns
+     *  the callback will not be running or run again.
+     *
+     *  \param id The timer to cancel.
+     *  \return bool Whether the timer was still pending.
+     */
+    bool cancel(TimerId id);
+
+    /**
+     *  \brief Number of pending timers.
+     *
+     *  \return size_t
+     */
+    size_t size();
+
+private:
+    struct Timer {
+        TimerId id;
+        uint64_t deadline;
+        uint64_t period;
+        bool due;
+        bool cancelled;
+        Timer* prev;
+        Timer* next;
+        std::function<void()> callback;
+    };
+
+    /*!< Length of a tick. */
+    std::chrono::milliseconds tick;
+
+    /*!< The time tick 0 started at. */
+    std::chrono::steady_clock::time_point origin;
+
+    /*!< Heads of the per-slot doubly linked timer lists. */
+    std::vector<Timer*> slots;
+
+    /*!< Pending timers by id. */
+    std::unordered_map<TimerId, Timer*> timers;
+
+    /*!< Expired timers waiting to run. */
+    std::deque<Timer*> due;
+
+    /*!< Last tick whose slot has been collected. */
+    uint64_t processed;
+
+    /*!< Tick the thread will next wake at, 0 if sleeping indefinitely. */
+    uint64_t wakeTick;
+
+    /*!< Id of the timer whose callback is running, 0 if none. */
+    TimerId running;
+
+    TimerId nextId;
+
+    bool stop;
+
+    std::mutex mutex;
+
+    /*!< Wakes the service thread when an earlier timer is scheduled. */
+    std::condition_variable wakeup;
+
+    /*!< Signalled whenever a callback returns. */
+    std::condition_variable finished;
+
+    /*!< Started lazily by the first schedule(). */
+    std::thread thread;
+
+    uint64_t now();
+    void link(Timer* timer);
+    void unlink(Timer* timer);
+    void collect(uint64_t tick);
+    uint64_t nextBusyTick();
+    void run();
+};
+
+#endif // TimerWheel_H
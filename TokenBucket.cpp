@@ -0,0 +1,37 @@
+#include "TokenBucket.h"
+#include <algorithm>
+#include <cmath>
+
+TokenBucket::TokenBucket(double rate, double burst) {
+    this->configure(rate, burst);
+}
+
+void TokenBucket::configure(double rate, double burst) {
+    std::lock_guard<std::mutex> guard(this->mutex);
+    this->rate = rate;
+    this->burst = std::max(burst, 1.0);
+    this->tokens = this->burst;
+    this->refilled = std::chrono::steady_clock::now();
+}
+
+int64_t TokenBucket::reserve() {
+    std::lock_guard<std::mutex> guard(this->mutex);
+    if (this->rate <= 0) {
+        return 0;
+    }
+
+    std::chrono::steady_clock::time_point now
+        = std::chrono::steady_clock::now();
+    double elapsed
+        = std::chrono::duration<double>(now - this->refilled).count();
+    this->tokens
+        = std::min(this->burst, this->tokens + elapsed * this->rate);
+    this->refilled = now;
+
+    this->tokens -= 1;
+    if (this->tokens >= 0) {
+        return 0;
+    }
+
+    return static_cast<int64_t>(std::ceil(-this->tokens / this->rate * 1000));
+}
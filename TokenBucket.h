@@ -0,0 +1,55 @@
+/**
+ *   \file TokenBucket.h
+ *   \brief A thread safe token bucket that hands out reservations.
+ *
+ *  Rather than failing when empty, reserve() takes a token anyway and says
+ *  how long to wait before using it. Callers queue up behind each other at
+ *  the bucket's rate instead of retrying.
+ */
+#ifndef TokenBucket_H
+#define TokenBucket_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+class TokenBucket {
+public:
+    /**
+     *  \brief Constructor
+     *
+     *  \param rate Tokens added per second. 0 or less for no limit.
+     *  \param burst Tokens the bucket holds at most.
+     *  \return TokenBucket
+     */
+    TokenBucket(double rate = 0, double burst = 1);
+
+    /**
+     *  \brief Changes the rate and size. Starts the bucket full.
+     *
+     *  \param rate Tokens added per second. 0 or less for no limit.
+     *  \param burst Tokens the bucket holds at most.
+     *  \return void
+     */
+    void configure(double rate, double burst);
+
+    /**
+     *  \brief Takes a token.
+     *
+     *  \return int64_t Milliseconds to wait before acting on it, 0 for now.
+     */
+    int64_t reserve();
+
+private:
+    double rate;
+    double burst;
+
+    /*!< Negative while reservations are waiting. */
+    double tokens;
+
+    std::chrono::steady_clock::time_point refilled;
+
+    std::mutex mutex;
+};
+
+#endif // TokenBucket_H
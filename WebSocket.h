@@ -8,6 +8,8 @@
  */
 #ifndef WebSocket_H
 #define WebSocket_H
+#include "LatencyHistogram.h"
+#include <cstdint>
 #include <string>
 
 class SocketDelegate;
@@ -19,6 +21,29 @@ typedef enum {
     SocketClosed
 } SocketState;
 
+/*!< Counters for what a WebSocket has written. */
+struct SendStats {
+    /*!< Frames handed to the transport. */
+    uint64_t frames;
+
+    /*!< Write syscalls they went out in. */
+    uint64_t writes;
+
+    SendStats()
+        : frames(0)
+        , writes(0) {
+    }
+
+    /**
+     *  \brief Average frames coalesced into one write.
+     *
+     *  \return double 0 if nothing has been written.
+     */
+    double framesPerWrite() const {
+        return this->writes ? double(this->frames) / this->writes : 0;
+    }
+};
+
 class WebSocket {
 protected:
     std::string url;
@@ -28,6 +53,9 @@ public:
     WebSocket() {
     }
 
+    virtual ~WebSocket() {
+    }
+
     /**
      *  \brief Constructor.
      *
@@ -72,6 +100,72 @@ public:
      */
     virtual void send(const std::string& message) = 0;
 
+    /**
+     *  \brief Send a message over websockets, taking ownership of it.
+     *
+     *  Implementations that queue messages should override this to move
+     *  message instead of copying it. The default just copies.
+     *
+     *  \param message The message, left in an unspecified state.
+     *  \return void
+     */
+    virtual void send(std::string&& message) {
+        this->send(static_cast<const std::string&>(message));
+    }
+
+    /**
+     *  \brief Holds sends back for up to us microseconds so a burst of them
+     *  goes out in one write.
+     *
+     *  0, the default, sends as soon as the socket gets to it. The default
+     *  implementation ignores the window.
+     *
+     *  \param us The batching window in microseconds.
+     *  \return void
+     */
+    virtual void setBatchWindow(int64_t us) {
+    }
+
+    /**
+     *  \brief Sends whatever a batching window is holding back, now.
+     *
+     *  \return void
+     */
+    virtual void flush() {
+    }
+
+    /**
+     *  \brief Counters for what has been written so far.
+     *
+     *  \return SendStats All zero unless the implementation keeps them.
+     */
+    virtual SendStats getSendStats() {
+        return SendStats();
+    }
+
+    /**
+     *  \brief Sends a PING frame every ms milliseconds while open.
+     *
+     *  The round trip to each PONG is measured at the transport, so unlike a
+     *  Phoenix heartbeat it doesn't include the server's scheduling delay.
+     *  The default implementation doesn't ping.
+     *
+     *  \param ms The interval in milliseconds, 0 to stop.
+     *  \return void
+     */
+    virtual void setPingInterval(int ms) {
+    }
+
+    /**
+     *  \brief Round trip times of the PINGs sent by setPingInterval.
+     *
+     *  \return LatencyHistogram A copy, empty unless the implementation
+     *  pings.
+     */
+    virtual LatencyHistogram getPingRtt() {
+        return LatencyHistogram();
+    }
+
     // // Send a Data
     // - (void)sendData:(nullable NSData *)data error:(NSError **)error;
 
@@ -40,16 +40,20 @@
     #define socketerrno WSAGetLastError()
     #define SOCKET_EAGAIN_EINPROGRESS WSAEINPROGRESS
     #define SOCKET_EWOULDBLOCK WSAEWOULDBLOCK
+    typedef WSAPOLLFD socketpollfd;
+    #define socketpoll WSAPoll
 #else
     #include <fcntl.h>
     #include <netdb.h>
     #include <netinet/tcp.h>
+    #include <poll.h>
     #include <stdio.h>
     #include <stdlib.h>
     #include <string.h>
     #include <sys/socket.h>
     #include <sys/time.h>
     #include <sys/types.h>
+    #include <sys/uio.h>
     #include <unistd.h>
     #include <stdint.h>
     #ifndef _SOCKET_T_DEFINED
@@ -67,18 +71,70 @@
     #define socketerrno errno
     #define SOCKET_EAGAIN_EINPROGRESS EAGAIN
     #define SOCKET_EWOULDBLOCK EWOULDBLOCK
+    typedef struct pollfd socketpollfd;
+    #define socketpoll ::poll
 #endif
 
+#if !defined(EASYWSCLIENT_NO_SIMD) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+    #define EASYWSCLIENT_SIMD_X86
+    #include <immintrin.h>
+    #if defined(__GNUC__)
+        #define EASYWSCLIENT_TARGET(isa) __attribute__((target(isa)))
+    #else
+        #include <intrin.h>
+        #define EASYWSCLIENT_TARGET(isa)
+    #endif
+#endif
+
+#include <deque>
 #include <vector>
 #include <string>
 
 #include "easywsclient.hpp"
 
+#ifndef EASYWSCLIENT_RECV_SIZE
+    // Free space guaranteed in rxbuf before each recv(). Override at build time
+    // to trade memory per connection for fewer syscalls on bursty sockets.
+    #define EASYWSCLIENT_RECV_SIZE 16384
+#endif
+
+#ifndef EASYWSCLIENT_RECV_SHRINK
+    // Once drained, rxbuf is cut back to EASYWSCLIENT_RECV_SIZE if a large
+    // frame left it holding more than this many times that.
+    #define EASYWSCLIENT_RECV_SHRINK 4
+#endif
+
+#ifndef EASYWSCLIENT_TX_IOV
+    // Maximum number of segments handed to a single gathered write.
+    #define EASYWSCLIENT_TX_IOV 64
+#endif
+
+#ifndef EASYWSCLIENT_TX_COPY
+    // Payloads smaller than this are packed next to their header; larger ones
+    // are moved into the transmit queue as their own segment.
+    #define EASYWSCLIENT_TX_COPY 4096
+#endif
+
+#ifndef EASYWSCLIENT_TX_SEGMENT
+    // Packed segments are sealed at this size so sent bytes can be released.
+    #define EASYWSCLIENT_TX_SEGMENT 65536
+#endif
+
 using easywsclient::Callback_Imp;
 using easywsclient::BytesCallback_Imp;
 
 namespace { // private module-only namespace
 
+// Most PONG payloads held for dispatchPongs(). Older ones are dropped, so
+// neither a caller that never collects them nor a peer sending unsolicited
+// PONGs can grow the queue without bound.
+const size_t max_pending_pongs = 16;
+
+// Longest poll() wait when the wake socket couldn't be made. Nothing can
+// break into the wait then, so it has to end on its own for writes queued
+// by other threads, close frames included, to go out.
+const int unwakeable_poll_ms = 10;
+
 socket_t hostname_connect(const std::string& hostname, int port) {
     struct addrinfo hints;
     struct addrinfo *result;
@@ -109,19 +165,147 @@ socket_t hostname_connect(const std::string& hostname, int port) {
     return sockfd;
 }
 
+socket_t wakeup_connect() {
+    // A loopback UDP socket connected to itself. Sending a byte on it makes
+    // it readable, which breaks another thread out of a blocking poll().
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    socket_t fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd == INVALID_SOCKET) { return INVALID_SOCKET; }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == SOCKET_ERROR
+        || getsockname(fd, (struct sockaddr *) &addr, &len) == SOCKET_ERROR
+        || connect(fd, (struct sockaddr *) &addr, len) == SOCKET_ERROR) {
+        closesocket(fd);
+        return INVALID_SOCKET;
+    }
+#ifdef _WIN32
+    u_long on = 1;
+    ioctlsocket(fd, FIONBIO, &on);
+#else
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+#endif
+    return fd;
+}
+
+// XOR data with the repeating 4 byte masking key, as required for frames
+// sent by a client (and, rarely, masked frames from a server). The SIMD
+// kernels handle whole 16/32 byte blocks, which keeps the key phase aligned,
+// and leave the tail to the scalar loop.
+typedef void (*mask_function)(uint8_t* data, size_t n, const uint8_t* key);
+
+void mask_scalar(uint8_t* data, size_t n, const uint8_t* key) {
+    const uint8_t key8[8] = { key[0], key[1], key[2], key[3], key[0], key[1], key[2], key[3] };
+    uint64_t key64;
+    size_t i = 0;
+    memcpy(&key64, key8, 8);
+    for (; i + 8 <= n; i += 8) {
+        uint64_t v;
+        memcpy(&v, data + i, 8);
+        v ^= key64;
+        memcpy(data + i, &v, 8);
+    }
+    for (; i != n; ++i) { data[i] ^= key[i&0x3]; }
+}
+
+#ifdef EASYWSCLIENT_SIMD_X86
+EASYWSCLIENT_TARGET("sse2")
+void mask_sse2(uint8_t* data, size_t n, const uint8_t* key) {
+    int32_t key32;
+    size_t i = 0;
+    memcpy(&key32, key, 4);
+    const __m128i k = _mm_set1_epi32(key32);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (data + i));
+        _mm_storeu_si128((__m128i *) (data + i), _mm_xor_si128(v, k));
+    }
+    mask_scalar(data + i, n - i, key);
+}
+
+EASYWSCLIENT_TARGET("avx2")
+void mask_avx2(uint8_t* data, size_t n, const uint8_t* key) {
+    int32_t key32;
+    size_t i = 0;
+    memcpy(&key32, key, 4);
+    const __m256i k = _mm256_set1_epi32(key32);
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (data + i));
+        _mm256_storeu_si256((__m256i *) (data + i), _mm256_xor_si256(v, k));
+    }
+    mask_scalar(data + i, n - i, key);
+}
+
+bool cpu_supports(const char* isa) {
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    return strcmp(isa, "avx2") == 0 ? __builtin_cpu_supports("avx2") : __builtin_cpu_supports("sse2");
+#else
+    int info[4];
+    if (strcmp(isa, "sse2") == 0) {
+        __cpuid(info, 1);
+        return (info[3] & (1 << 26)) != 0;
+    }
+    __cpuid(info, 0);
+    if (info[0] < 7) { return false; }
+    __cpuid(info, 1);
+    // AVX2 also needs the OS to save the YMM registers (OSXSAVE + XCR0).
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) { return false; }
+    if ((_xgetbv(0) & 0x6) != 0x6) { return false; }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#endif
+}
+#endif
+
+mask_function select_mask() {
+#ifdef EASYWSCLIENT_SIMD_X86
+    if (cpu_supports("avx2")) { return mask_avx2; }
+    if (cpu_supports("sse2")) { return mask_sse2; }
+#endif
+    return mask_scalar;
+}
+
+void mask_bytes(uint8_t* data, size_t n, const uint8_t* key) {
+    static const mask_function mask = select_mask();
+    mask(data, n, key);
+}
+
+#ifdef _WIN32
+typedef WSABUF txiovec;
+void set_iovec(txiovec& v, const uint8_t* base, size_t len) { v.buf = (CHAR*) base; v.len = (ULONG) len; }
+ssize_t send_iovec(socket_t sockfd, txiovec* iov, int iovcnt) {
+    DWORD sent = 0;
+    if (WSASend(sockfd, iov, iovcnt, &sent, 0, NULL, NULL) == SOCKET_ERROR) { return -1; }
+    return (ssize_t) sent;
+}
+#else
+typedef struct iovec txiovec;
+void set_iovec(txiovec& v, const uint8_t* base, size_t len) { v.iov_base = (void*) base; v.iov_len = len; }
+ssize_t send_iovec(socket_t sockfd, txiovec* iov, int iovcnt) { return writev(sockfd, iov, iovcnt); }
+#endif
+
 
 class _DummyWebSocket : public easywsclient::WebSocket
 {
   public:
     void poll(int timeout) { }
+    void wakeup() { }
     void send(const std::string& message) { }
+    void send(std::string&& message) { }
     void sendBinary(const std::string& message) { }
     void sendBinary(const std::vector<uint8_t>& message) { }
     void sendPing() { }
+    void sendPing(const std::string& payload) { }
     void close() { } 
     readyStateValues getReadyState() const { return CLOSED; }
+    TxStats getTxStats() const { TxStats stats = { 0, 0 }; return stats; }
+    int getSocketFd() const { return -1; }
     void _dispatch(Callback_Imp & callable) { }
     void _dispatchBinary(BytesCallback_Imp& callable) { }
+    void _dispatchPongs(Callback_Imp& callable) { }
 };
 
 
@@ -165,21 +349,51 @@ class _RealWebSocket : public easywsclient::WebSocket
         uint8_t masking_key[4];
     };
 
+    // Received bytes live in rxbuf[rxhead, rxtail). Frames are consumed by
+    // advancing rxhead; unparsed bytes only move when recv() needs room.
     std::vector<uint8_t> rxbuf;
-    std::vector<uint8_t> txbuf;
+    size_t rxhead;
+    size_t rxtail;
+    // Outbound bytes are a queue of segments sent with gathered writes. Small
+    // frames are packed into the open tail segment; large payloads are moved
+    // in as a segment of their own. txoffset counts the bytes of
+    // txqueue.front() already on the wire.
+    std::deque<std::string> txqueue;
+    size_t txoffset;
+    bool txsealed;
+    TxStats txstats;
     std::vector<uint8_t> receivedData;
+    // Payloads of PONG frames waiting for dispatchPongs(), the latest
+    // max_pending_pongs of them.
+    std::deque<std::string> pongs;
 
     socket_t sockfd;
+    socket_t wakefd;
     readyStateValues readyState;
     bool useMask;
 
-    _RealWebSocket(socket_t sockfd, bool useMask) : sockfd(sockfd), readyState(OPEN), useMask(useMask) {
+    _RealWebSocket(socket_t sockfd, bool useMask) : rxhead(0), rxtail(0), txoffset(0), txsealed(false), sockfd(sockfd), wakefd(wakeup_connect()), readyState(OPEN), useMask(useMask) {
+        txstats.frames = 0;
+        txstats.writes = 0;
+    }
+
+    ~_RealWebSocket() {
+        if (readyState != CLOSED) { closesocket(sockfd); }
+        if (wakefd != INVALID_SOCKET) { closesocket(wakefd); }
     }
 
     readyStateValues getReadyState() const {
       return readyState;
     }
 
+    TxStats getTxStats() const {
+      return txstats;
+    }
+
+    int getSocketFd() const {
+      return readyState == CLOSED ? -1 : (int) sockfd;
+    }
+
     void poll(int timeout) { // timeout in milliseconds
         if (readyState == CLOSED) {
             if (timeout > 0) {
@@ -189,39 +403,52 @@ class _RealWebSocket : public easywsclient::WebSocket
             return;
         }
         if (timeout != 0) {
-            fd_set rfds;
-            fd_set wfds;
-            timeval tv = { timeout/1000, (timeout%1000) * 1000 };
-            FD_ZERO(&rfds);
-            FD_ZERO(&wfds);
-            FD_SET(sockfd, &rfds);
-            if (txbuf.size()) { FD_SET(sockfd, &wfds); }
-            select(sockfd + 1, &rfds, &wfds, 0, timeout > 0 ? &tv : 0);
+            // poll() rather than select(): an fd_set can't hold descriptors
+            // past FD_SETSIZE (1024 on Linux), and processes holding many
+            // connections get there.
+            socketpollfd fds[2];
+            int nfds = 1;
+            fds[0].fd = sockfd;
+            fds[0].events = POLLIN | (txqueue.empty() ? 0 : POLLOUT);
+            fds[0].revents = 0;
+            if (wakefd != INVALID_SOCKET) {
+                fds[1].fd = wakefd;
+                fds[1].events = POLLIN;
+                fds[1].revents = 0;
+                nfds = 2;
+            }
+            int wait = timeout > 0 ? timeout : -1;
+            if (wakefd == INVALID_SOCKET
+                && (wait < 0 || wait > unwakeable_poll_ms)) {
+                wait = unwakeable_poll_ms;
+            }
+            socketpoll(fds, nfds, wait);
+            if (nfds == 2 && (fds[1].revents & POLLIN)) {
+                char drain[64];
+                while (recv(wakefd, drain, sizeof(drain), 0) > 0) { }
+            }
         }
         while (true) {
             // FD_ISSET(0, &rfds) will be true
-            int N = rxbuf.size();
             ssize_t ret;
-            rxbuf.resize(N + 1500);
-            ret = recv(sockfd, (char*)&rxbuf[0] + N, 1500, 0);
+            rxreserve(EASYWSCLIENT_RECV_SIZE);
+            ret = recv(sockfd, (char*)&rxbuf[0] + rxtail, rxbuf.size() - rxtail, 0);
             if (false) { }
             else if (ret < 0 && (socketerrno == SOCKET_EWOULDBLOCK || socketerrno == SOCKET_EAGAIN_EINPROGRESS)) {
-                rxbuf.resize(N);
                 break;
             }
             else if (ret <= 0) {
-                rxbuf.resize(N);
                 closesocket(sockfd);
                 readyState = CLOSED;
                 fputs(ret < 0 ? "Connection error!\n" : "Connection closed!\n", stderr);
                 break;
             }
             else {
-                rxbuf.resize(N + ret);
+                rxtail += ret;
             }
         }
-        while (txbuf.size()) {
-            int ret = ::send(sockfd, (char*)&txbuf[0], txbuf.size(), 0);
+        while (!txqueue.empty()) {
+            ssize_t ret = txsend();
             if (false) { } // ??
             else if (ret < 0 && (socketerrno == SOCKET_EWOULDBLOCK || socketerrno == SOCKET_EAGAIN_EINPROGRESS)) {
                 break;
@@ -233,47 +460,100 @@ class _RealWebSocket : public easywsclient::WebSocket
                 break;
             }
             else {
-                txbuf.erase(txbuf.begin(), txbuf.begin() + ret);
+                txconsume(ret);
             }
         }
-        if (!txbuf.size() && readyState == CLOSING) {
+        if (txqueue.empty() && readyState == CLOSING) {
             closesocket(sockfd);
             readyState = CLOSED;
         }
     }
 
+    ssize_t txsend() {
+        // Gather queued segments into one write, skipping the part of the
+        // front segment that a previous partial write already sent.
+        txiovec iov[EASYWSCLIENT_TX_IOV];
+        int iovcnt = 0;
+        size_t skip = txoffset;
+        for (std::deque<std::string>::iterator it = txqueue.begin(); it != txqueue.end() && iovcnt < EASYWSCLIENT_TX_IOV; ++it) {
+            set_iovec(iov[iovcnt++], (const uint8_t *) it->data() + skip, it->size() - skip);
+            skip = 0;
+        }
+        ++txstats.writes;
+        return send_iovec(sockfd, iov, iovcnt);
+    }
+
+    void txconsume(size_t n) {
+        n += txoffset;
+        while (!txqueue.empty() && n >= txqueue.front().size()) {
+            n -= txqueue.front().size();
+            txqueue.pop_front();
+        }
+        txoffset = n;
+    }
+
+    std::string& txpacked() {
+        if (txqueue.empty() || txsealed || txqueue.back().size() >= EASYWSCLIENT_TX_SEGMENT) {
+            txqueue.push_back(std::string());
+            txsealed = false;
+        }
+        return txqueue.back();
+    }
+
+    void rxreserve(size_t n) {
+        if (rxbuf.size() - rxtail >= n) { return; }
+        if (rxhead > 0) {
+            // Slide the partial frame left; this only ever moves bytes that
+            // haven't been parsed yet, at most once per recv().
+            if (rxtail > rxhead) { memmove(&rxbuf[0], &rxbuf[rxhead], rxtail - rxhead); }
+            rxtail -= rxhead;
+            rxhead = 0;
+        }
+        if (rxbuf.size() - rxtail < n) { rxbuf.resize(rxtail + n); }
+    }
+
     // Callable must have signature: void(const std::string & message).
     // Should work with C functions, C++ functors, and C++11 std::function and
     // lambda:
     //template<class Callable>
     //void dispatch(Callable callable)
     virtual void _dispatch(Callback_Imp & callable) {
-        struct CallbackAdapter : public BytesCallback_Imp
-            // Adapt void(const std::string<uint8_t>&) to void(const std::string&)
-        {
-            Callback_Imp& callable;
-            CallbackAdapter(Callback_Imp& callable) : callable(callable) { }
-            void operator()(const std::vector<uint8_t>& message) {
-                std::string stringMessage(message.begin(), message.end());
-                callable(stringMessage);
-            }
-        };
-        CallbackAdapter bytesCallback(callable);
-        _dispatchBinary(bytesCallback);
+        dispatchMessages<std::string>(callable);
     }
 
     virtual void _dispatchBinary(BytesCallback_Imp & callable) {
+        dispatchMessages<std::vector<uint8_t> >(callable);
+    }
+
+    virtual void _dispatchPongs(Callback_Imp & callable) {
+        for (size_t i = 0; i < pongs.size(); ++i) {
+            callable(pongs[i]);
+        }
+        pongs.clear();
+    }
+
+    template<class Message, class Callback>
+    void dispatchMessages(Callback & callable) {
         // TODO: consider acquiring a lock on rxbuf...
         while (true) {
             wsheader_type ws;
-            if (rxbuf.size() < 2) { return; /* Need at least 2 */ }
-            const uint8_t * data = (uint8_t *) &rxbuf[0]; // peek, but don't consume
+            size_t avail = rxtail - rxhead;
+            if (avail == 0) {
+                rxhead = rxtail = 0;
+                // Don't hold on to a large frame's worth of buffer for the
+                // life of the connection.
+                if (rxbuf.capacity() > (size_t) EASYWSCLIENT_RECV_SHRINK * EASYWSCLIENT_RECV_SIZE) {
+                    std::vector<uint8_t>(EASYWSCLIENT_RECV_SIZE).swap(rxbuf);
+                }
+            }
+            if (avail < 2) { return; /* Need at least 2 */ }
+            uint8_t * data = (uint8_t *) &rxbuf[rxhead]; // peek, but don't consume
             ws.fin = (data[0] & 0x80) == 0x80;
             ws.opcode = (wsheader_type::opcode_type) (data[0] & 0x0f);
             ws.mask = (data[1] & 0x80) == 0x80;
             ws.N0 = (data[1] & 0x7f);
             ws.header_size = 2 + (ws.N0 == 126? 2 : 0) + (ws.N0 == 127? 8 : 0) + (ws.mask? 4 : 0);
-            if (rxbuf.size() < ws.header_size) { return; /* Need: ws.header_size - rxbuf.size() */ }
+            if (avail < ws.header_size) { return; /* Need: ws.header_size - avail */ }
             int i = 0;
             if (ws.N0 < 126) {
                 ws.N = ws.N0;
@@ -309,7 +589,8 @@ class _RealWebSocket : public easywsclient::WebSocket
                 ws.masking_key[2] = 0;
                 ws.masking_key[3] = 0;
             }
-            if (rxbuf.size() < ws.header_size+ws.N) { return; /* Need: ws.header_size+ws.N - rxbuf.size() */ }
+            if (avail < ws.header_size+ws.N) { return; /* Need: ws.header_size+ws.N - avail */ }
+            uint8_t * payload = data + ws.header_size;
 
             // We got a whole message, now do something with it:
             if (false) { }
@@ -318,55 +599,90 @@ class _RealWebSocket : public easywsclient::WebSocket
                 || ws.opcode == wsheader_type::BINARY_FRAME
                 || ws.opcode == wsheader_type::CONTINUATION
             ) {
-                if (ws.mask) { for (size_t i = 0; i != ws.N; ++i) { rxbuf[i+ws.header_size] ^= ws.masking_key[i&0x3]; } }
-                receivedData.insert(receivedData.end(), rxbuf.begin()+ws.header_size, rxbuf.begin()+ws.header_size+(size_t)ws.N);// just feed
-                if (ws.fin) {
-                    callable((const std::vector<uint8_t>) receivedData);
-                    receivedData.erase(receivedData.begin(), receivedData.end());
-                    std::vector<uint8_t> ().swap(receivedData);// free memory
+                if (ws.mask) { mask_bytes(payload, (size_t)ws.N, ws.masking_key); }
+                if (ws.fin && receivedData.empty()) {
+                    // Unfragmented: the message is copied out of rxbuf once
+                    // and ownership goes to the callable.
+                    Message message(payload, payload+(size_t)ws.N);
+                    callable(message);
+                }
+                else {
+                    receivedData.insert(receivedData.end(), payload, payload+(size_t)ws.N);// just feed
+                    if (ws.fin) {
+                        Message message(receivedData.begin(), receivedData.end());
+                        std::vector<uint8_t> ().swap(receivedData);// free memory
+                        callable(message);
+                    }
                 }
             }
             else if (ws.opcode == wsheader_type::PING) {
-                if (ws.mask) { for (size_t i = 0; i != ws.N; ++i) { rxbuf[i+ws.header_size] ^= ws.masking_key[i&0x3]; } }
-                std::string data(rxbuf.begin()+ws.header_size, rxbuf.begin()+ws.header_size+(size_t)ws.N);
-                sendData(wsheader_type::PONG, data.size(), data.begin(), data.end());
+                if (ws.mask) { mask_bytes(payload, (size_t)ws.N, ws.masking_key); }
+                sendData(wsheader_type::PONG, (const char *) payload, (size_t)ws.N, NULL);
+            }
+            else if (ws.opcode == wsheader_type::PONG) {
+                if (ws.mask) { mask_bytes(payload, (size_t)ws.N, ws.masking_key); }
+                if (pongs.size() == max_pending_pongs) { pongs.pop_front(); }
+                pongs.push_back(std::string(payload, payload+(size_t)ws.N));
             }
-            else if (ws.opcode == wsheader_type::PONG) { }
             else if (ws.opcode == wsheader_type::CLOSE) { close(); }
             else { fprintf(stderr, "ERROR: Got unexpected WebSocket message.\n"); close(); }
 
-            rxbuf.erase(rxbuf.begin(), rxbuf.begin() + ws.header_size+(size_t)ws.N);
+            rxhead += ws.header_size+(size_t)ws.N;
+        }
+    }
+
+    void wakeup() {
+        if (wakefd != INVALID_SOCKET) {
+            char byte = 0;
+            ::send(wakefd, &byte, 1, 0);
         }
     }
 
     void sendPing() {
-        std::string empty;
-        sendData(wsheader_type::PING, empty.size(), empty.begin(), empty.end());
+        sendData(wsheader_type::PING, std::string());
+    }
+
+    void sendPing(const std::string& payload) {
+        sendData(wsheader_type::PING, payload);
     }
 
     void send(const std::string& message) {
-        sendData(wsheader_type::TEXT_FRAME, message.size(), message.begin(), message.end());
+        sendData(wsheader_type::TEXT_FRAME, message);
+    }
+
+    void send(std::string&& message) {
+        sendData(wsheader_type::TEXT_FRAME, std::move(message));
     }
 
     void sendBinary(const std::string& message) {
-        sendData(wsheader_type::BINARY_FRAME, message.size(), message.begin(), message.end());
+        sendData(wsheader_type::BINARY_FRAME, message);
     }
 
     void sendBinary(const std::vector<uint8_t>& message) {
-        sendData(wsheader_type::BINARY_FRAME, message.size(), message.begin(), message.end());
+        sendData(wsheader_type::BINARY_FRAME, (const char *) message.data(), message.size(), NULL);
+    }
+
+    void sendData(wsheader_type::opcode_type type, const std::string& message) {
+        sendData(type, message.data(), message.size(), NULL);
     }
 
-    template<class Iterator>
-    void sendData(wsheader_type::opcode_type type, uint64_t message_size, Iterator message_begin, Iterator message_end) {
+    void sendData(wsheader_type::opcode_type type, std::string&& message) {
+        sendData(type, message.data(), message.size(), &message);
+    }
+
+    // Frames message_size bytes at data. They are copied once, into the
+    // packed buffer or a queue entry of their own, unless owned holds them,
+    // in which case a large payload is taken from it without a copy.
+    void sendData(wsheader_type::opcode_type type, const char* data, size_t message_size, std::string* owned) {
         // TODO:
         // Masking key should (must) be derived from a high quality random
         // number generator, to mitigate attacks on non-WebSocket friendly
         // middleware:
         const uint8_t masking_key[4] = { 0x12, 0x34, 0x56, 0x78 };
-        // TODO: consider acquiring a lock on txbuf...
+        // TODO: consider acquiring a lock on txqueue...
         if (readyState == CLOSING || readyState == CLOSED) { return; }
-        std::vector<uint8_t> header;
-        header.assign(2 + (message_size >= 126 ? 2 : 0) + (message_size >= 65536 ? 6 : 0) + (useMask ? 4 : 0), 0);
+        uint8_t header[14];
+        const size_t header_size = 2 + (message_size >= 126 ? 2 : 0) + (message_size >= 65536 ? 6 : 0) + (useMask ? 4 : 0);
         header[0] = 0x80 | type;
         if (false) { }
         else if (message_size < 126) {
@@ -406,11 +722,27 @@ class _RealWebSocket : public easywsclient::WebSocket
                 header[13] = masking_key[3];
             }
         }
-        // N.B. - txbuf will keep growing until it can be transmitted over the socket:
-        txbuf.insert(txbuf.end(), header.begin(), header.end());
-        txbuf.insert(txbuf.end(), message_begin, message_end);
+        // N.B. - txqueue will keep growing until it can be transmitted over the socket:
+        ++txstats.frames;
+        std::string& packed = txpacked();
+        packed.append((const char *) header, header_size);
+        if (message_size == 0) { return; }
+        uint8_t* payload;
+        if (message_size < EASYWSCLIENT_TX_COPY) {
+            size_t offset = packed.size();
+            packed.append(data, message_size);
+            payload = (uint8_t *) &packed[offset];
+        }
+        else {
+            txqueue.push_back(std::string());
+            if (owned) { txqueue.back().swap(*owned); }
+            else { txqueue.back().assign(data, message_size); }
+            payload = (uint8_t *) &txqueue.back()[0];
+            txsealed = true;
+        }
+        // Masked where it lies, so the payload isn't copied to be masked.
         if (useMask) {
-            for (size_t i = 0; i != message_size; ++i) { *(txbuf.end() - message_size + i) ^= masking_key[i&0x3]; }
+            mask_bytes(payload, message_size, masking_key);
         }
     }
 
@@ -418,8 +750,7 @@ class _RealWebSocket : public easywsclient::WebSocket
         if(readyState == CLOSING || readyState == CLOSED) { return; }
         readyState = CLOSING;
         uint8_t closeFrame[6] = {0x88, 0x80, 0x00, 0x00, 0x00, 0x00}; // last 4 bytes are a masking key
-        std::vector<uint8_t> header(closeFrame, closeFrame+6);
-        txbuf.insert(txbuf.end(), header.begin(), header.end());
+        txpacked().append((const char *) closeFrame, 6);
     }
 
 };
@@ -8,18 +8,24 @@
 // wget https://raw.github.com/dhbaird/easywsclient/master/easywsclient.hpp
 // wget https://raw.github.com/dhbaird/easywsclient/master/easywsclient.cpp
 
+#include <stdint.h>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace easywsclient {
 
-struct Callback_Imp { virtual void operator()(const std::string& message) = 0; };
-struct BytesCallback_Imp { virtual void operator()(const std::vector<uint8_t>& message) = 0; };
+// Messages are handed to callbacks as rvalues, so a callable taking its
+// argument by value takes ownership of the received buffer without a copy.
+struct Callback_Imp { virtual void operator()(std::string& message) = 0; };
+struct BytesCallback_Imp { virtual void operator()(std::vector<uint8_t>& message) = 0; };
 
 class WebSocket {
   public:
     typedef WebSocket * pointer;
     typedef enum readyStateValues { CLOSING, CLOSED, CONNECTING, OPEN } readyStateValues;
+    // Frames queued and write syscalls made, for frames-per-write.
+    struct TxStats { uint64_t frames; uint64_t writes; };
 
     // Factories:
     static pointer create_dummy();
@@ -28,13 +34,18 @@ class WebSocket {
 
     // Interfaces:
     virtual ~WebSocket() { }
-    virtual void poll(int timeout = 0) = 0; // timeout in milliseconds
+    virtual void poll(int timeout = 0) = 0; // timeout in milliseconds, -1 blocks
+    virtual void wakeup() = 0; // interrupts a poll() blocked in another thread
     virtual void send(const std::string& message) = 0;
+    virtual void send(std::string&& message) = 0; // takes ownership, no copy
     virtual void sendBinary(const std::string& message) = 0;
     virtual void sendBinary(const std::vector<uint8_t>& message) = 0;
     virtual void sendPing() = 0;
+    virtual void sendPing(const std::string& payload) = 0;
     virtual void close() = 0;
     virtual readyStateValues getReadyState() const = 0;
+    virtual TxStats getTxStats() const = 0; // only from the polling thread
+    virtual int getSocketFd() const = 0; // for an external poller, -1 if closed
 
     template<class Callable>
     void dispatch(Callable callable)
@@ -43,12 +54,27 @@ class WebSocket {
         struct _Callback : public Callback_Imp {
             Callable& callable;
             _Callback(Callable& callable) : callable(callable) { }
-            void operator()(const std::string& message) { callable(message); }
+            void operator()(std::string& message) { callable(std::move(message)); }
         };
         _Callback callback(callable);
         _dispatch(callback);
     }
 
+    template<class Callable>
+    void dispatchPongs(Callable callable)
+        // Hands over the payloads of PONG frames found by dispatch() or
+        // dispatchBinary() since the last call, oldest first. Only the
+        // latest 16 are held; older ones are dropped.
+    {
+        struct _Callback : public Callback_Imp {
+            Callable& callable;
+            _Callback(Callable& callable) : callable(callable) { }
+            void operator()(std::string& message) { callable(std::move(message)); }
+        };
+        _Callback callback(callable);
+        _dispatchPongs(callback);
+    }
+
     template<class Callable>
     void dispatchBinary(Callable callable)
         // For callbacks that accept a std::vector<uint8_t> argument.
@@ -56,7 +82,7 @@ class WebSocket {
         struct _Callback : public BytesCallback_Imp {
             Callable& callable;
             _Callback(Callable& callable) : callable(callable) { }
-            void operator()(const std::vector<uint8_t>& message) { callable(message); }
+            void operator()(std::vector<uint8_t>& message) { callable(std::move(message)); }
         };
         _Callback callback(callable);
         _dispatchBinary(callback);
@@ -65,6 +91,7 @@ class WebSocket {
   protected:
     virtual void _dispatch(Callback_Imp& callable) = 0;
     virtual void _dispatchBinary(BytesCallback_Imp& callable) = 0;
+    virtual void _dispatchPongs(Callback_Imp& callable) = 0;
 };
 
 } // namespace easywsclient